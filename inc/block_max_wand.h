@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "posting_cursor.h"
+#include "top_documents.h"
+
+// Cursor over the postings of one query term; a posting scores weight * term_freq
+struct TermCursor {
+	PostingCursor postings;
+	double weight = 0.0;
+};
+
+// Document-at-a-time evaluation of the cursors of one segment with Block-Max WAND pruning.
+// A document scores the sum over cursors on it, added up in the order of cursors. Documents
+// whose upper bound, from the row maxima first and from the block maxima next, is below
+// the threshold of top_documents are skipped undecoded; candidate(document_id, relevance)
+// is called for every other document and decides whether to add it. order is scratch memory.
+template <typename Candidate>
+void RunBlockMaxWand(std::vector<TermCursor>& cursors, std::vector<TermCursor*>& order, const TopDocuments& top_documents, Candidate candidate) {
+	const auto by_document_id = [](const TermCursor* lhs, const TermCursor* rhs) {
+		return lhs->postings.GetDocumentId() < rhs->postings.GetDocumentId();
+	};
+	const auto is_exhausted = [](const TermCursor* cursor) {
+		return cursor->postings.GetDocumentId() == PostingCursor::END;
+	};
+	order.clear();
+	for (TermCursor& cursor : cursors) {
+		order.push_back(&cursor);
+	}
+
+	while (true) {
+		order.erase(std::remove_if(order.begin(), order.end(), is_exhausted), order.end());
+		std::sort(order.begin(), order.end(), by_document_id);
+		const double threshold = top_documents.GetThreshold();
+
+		// Pivot: the first document the cursors up to it might lift to the threshold
+		double bound = 0.0;
+		size_t pivot = 0;
+		for (; pivot < order.size(); ++pivot) {
+			bound += order[pivot]->weight * order[pivot]->postings.GetMaxTermFreq();
+			if (bound >= threshold) {
+				break;
+			}
+		}
+		if (pivot == order.size()) {
+			return;
+		}
+		const int64_t pivot_id = order[pivot]->postings.GetDocumentId();
+		size_t last = pivot + 1U;
+		while (last < order.size() && order[last]->postings.GetDocumentId() == pivot_id) {
+			++last;
+		}
+
+		// Block maxima bound every document from the pivot up to the end of the nearest block
+		double block_bound = 0.0;
+		int64_t skip_to = last < order.size() ? order[last]->postings.GetDocumentId() : PostingCursor::END;
+		for (size_t i = 0; i < last; ++i) {
+			block_bound += order[i]->weight * order[i]->postings.SeekBlock(pivot_id);
+			const int64_t block_last = order[i]->postings.GetBlockLastDocumentId();
+			if (block_last != PostingCursor::END) {
+				skip_to = std::min(skip_to, block_last + 1);
+			}
+		}
+
+		if (block_bound < threshold) {
+			for (size_t i = 0; i < last; ++i) {
+				order[i]->postings.Seek(skip_to);
+			}
+		} else if (order[0]->postings.GetDocumentId() == pivot_id) {
+			double relevance = 0.0;
+			for (const TermCursor& cursor : cursors) {
+				if (cursor.postings.GetDocumentId() == pivot_id) {
+					relevance += cursor.postings.GetTermFreq() * cursor.weight;
+				}
+			}
+			if (relevance >= threshold) {
+				candidate(static_cast<int>(pivot_id), relevance);
+			}
+			for (size_t i = 0; i < last; ++i) {
+				order[i]->postings.Next();
+			}
+		} else {
+			for (size_t i = 0; i < last && order[i]->postings.GetDocumentId() < pivot_id; ++i) {
+				order[i]->postings.Seek(pivot_id);
+			}
+		}
+	}
+}
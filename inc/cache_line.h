@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// Data written by different threads is aligned to this so threads do not share cache lines
+const size_t CACHE_LINE_SIZE = 64;
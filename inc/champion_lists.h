@@ -0,0 +1,70 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "inverted_index.h"
+
+// Read-optimized companion of an inverted index. Per term it caches the logarithm of the
+// document frequency, so an inverse document frequency costs one subtraction, and for
+// terms with more than champion_count postings it keeps the champion_count postings of
+// the highest term frequency plus a bound of the frequencies left out. Rarer terms serve
+// their whole rows. Updates only touch the terms of the added or removed document.
+class ChampionLists {
+public:
+	// Disabled lists: updates are ignored
+	ChampionLists() = default;
+
+	explicit ChampionLists(size_t champion_count);
+
+	bool IsEnabled() const;
+
+	size_t GetChampionCount() const;
+
+	// Recomputes everything kept for the term from the index
+	void Rebuild(const InvertedIndex& index, TermId term_id);
+
+	// Called once the index holds the new posting of the term
+	void AddPosting(const InvertedIndex& index, TermId term_id, const Posting& posting);
+
+	// Called once the posting of the document is gone from the index
+	void RemovePosting(const InvertedIndex& index, TermId term_id, int document_id);
+
+	void SetDocumentCount(size_t document_count);
+
+	double GetInverseDocumentFreq(TermId term_id) const;
+
+	// Calls callback(document_id) for the champions of the term and returns the bound of
+	// the term frequencies of its other postings
+	template <typename Callback>
+	double ForEachChampion(const InvertedIndex& index, TermId term_id, Callback callback) const {
+		const auto it = champions_.find(term_id);
+		if (it == champions_.end()) {
+			index.ForEachPosting(term_id, [&callback](const Posting& posting) {
+				callback(posting.document_id);
+			});
+			return 0.0;
+		}
+		for (const Posting& posting : it->second.postings) {
+			callback(posting.document_id);
+		}
+
+		return it->second.rest_max_term_freq;
+	}
+
+private:
+	struct Champions {
+		// Highest term frequency first
+		PostingList postings;
+		// Upper bound of the term frequencies of postings left out; removals do not lower it
+		double rest_max_term_freq = 0.0;
+	};
+
+	size_t champion_count_ = 0;
+	double log_document_count_ = 0.0;
+	std::vector<double> log_document_freqs_;
+	std::unordered_map<TermId, Champions> champions_;
+
+	// Caches the document frequency and tells whether the term needs a champion list
+	bool UpdateDocumentFreq(const InvertedIndex& index, TermId term_id);
+};
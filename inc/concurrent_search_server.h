@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "search_server.h"
+
+// Serves queries while documents are added and removed. Readers pin an immutable
+// snapshot of the server; writers change a private master copy and publish new
+// snapshots atomically. Snapshots share the sealed index segments with the master, but
+// a publish still copies the document metadata, the dictionary and the mutable segment,
+// which costs time linear in the number of documents and terms.
+//
+// Writes become visible to new snapshots on Publish, once publish_interval documents
+// have been written since the last publish, and at the latest max_staleness after the
+// oldest unpublished write: a background thread publishes them when the writers fall
+// quiet or write too little to reach the interval.
+class ConcurrentSearchServer {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Publishes after every document count / ADAPTIVE_PUBLISH_RATIO written documents, so
+	// the copying costs a constant amortized time per write however large the corpus grows
+	static constexpr size_t ADAPTIVE_PUBLISH_INTERVAL = 0;
+	static constexpr size_t ADAPTIVE_PUBLISH_RATIO = 64;
+	static constexpr Clock::duration DEFAULT_MAX_STALENESS = std::chrono::milliseconds(100);
+
+	// A small fixed interval copies the whole server that often; a long max_staleness lets
+	// removed documents be found that long, Clock::duration::max() leaves writes unpublished
+	// until the interval is reached
+	explicit ConcurrentSearchServer(SearchServer search_server, size_t publish_interval = ADAPTIVE_PUBLISH_INTERVAL, Clock::duration max_staleness = DEFAULT_MAX_STALENESS);
+
+	ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+
+	ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+	// Stops the background publisher; unpublished writes are dropped with the master
+	~ConcurrentSearchServer();
+
+	// The snapshot stays valid and unchanged for as long as the caller holds it
+	std::shared_ptr<const SearchServer> GetSnapshot() const;
+
+	// The document is found by snapshots taken max_staleness after the call or earlier
+	void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+	template <typename ExecutionPolicy, typename DocumentRange>
+	void AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents) {
+		std::lock_guard guard(writer_mutex_);
+		master_.AddDocuments(policy, documents);
+		CountWrites(static_cast<size_t>(std::distance(std::begin(documents), std::end(documents))));
+	}
+
+	// Snapshots taken max_staleness after the call or earlier no longer find the document;
+	// snapshots already pinned keep finding it
+	void RemoveDocument(int document_id);
+
+	// Makes all writes visible to snapshots taken afterwards
+	void Publish();
+
+	// Runs on the current snapshot. MatchDocument is not forwarded because its words
+	// point into the snapshot; pin one with GetSnapshot instead.
+	template <typename... Args>
+	std::vector<Document> FindTopDocuments(const Args&... args) const {
+		return GetSnapshot()->FindTopDocuments(args...);
+	}
+
+	int GetDocumentCount() const;
+
+private:
+	// Serializes writers; readers never take it
+	std::mutex writer_mutex_;
+	SearchServer master_;
+	// Accessed only through std::atomic_load and std::atomic_store
+	std::shared_ptr<const SearchServer> snapshot_;
+	size_t publish_interval_;
+	Clock::duration max_staleness_;
+	size_t unpublished_writes_ = 0;
+	// Time of the oldest unpublished write
+	Clock::time_point first_unpublished_write_;
+	// Wakes the publisher on the first unpublished write and on destruction
+	std::condition_variable publisher_wake_up_;
+	bool is_stopping_ = false;
+	std::thread publisher_;
+
+	// Caller must hold writer_mutex_
+	void CountWrites(size_t document_count);
+
+	// Caller must hold writer_mutex_
+	void PublishMaster();
+
+	// Publishes writes that have waited max_staleness_ until the server is destroyed
+	void RunPublisher();
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <execution>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "index_file.h"
+#include "search_server.h"
+
+// Streams documents from a corpus file without copying their text. Every line is one
+// record of four tab-separated fields:
+//     id <TAB> status <TAB> ratings separated by spaces <TAB> text
+// where status is ACTUAL, IRRELEVANT, BANNED or REMOVED. Empty lines are skipped.
+// The file is memory-mapped and document texts are views into it, valid while the reader lives.
+class CorpusReader {
+public:
+	explicit CorpusReader(const std::string& path);
+
+	// Replaces the contents of batch with up to max_count next documents, reusing its
+	// rating vectors; returns false once the file is exhausted
+	bool ReadBatch(std::vector<RawDocument>& batch, size_t max_count);
+
+private:
+	std::shared_ptr<const MappedFile> file_;
+	std::string_view rest_;
+	size_t line_number_ = 0;
+
+	void ParseRecord(std::string_view line, RawDocument& document) const;
+};
+
+const size_t DEFAULT_CORPUS_BATCH_SIZE = 4096;
+
+// Adds all documents of a corpus file, one AddDocuments batch at a time
+template <typename ExecutionPolicy>
+void AddDocumentsFromFile(const ExecutionPolicy& policy, SearchServer& search_server, const std::string& path, size_t batch_size = DEFAULT_CORPUS_BATCH_SIZE) {
+	CorpusReader reader(path);
+	std::vector<RawDocument> batch;
+	while (reader.ReadBatch(batch, batch_size)) {
+		search_server.AddDocuments(policy, batch);
+	}
+}
+
+void AddDocumentsFromFile(SearchServer& search_server, const std::string& path, size_t batch_size = DEFAULT_CORPUS_BATCH_SIZE);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <ostream>
+#include <string_view>
+#include <vector>
 
 enum class DocumentStatus {
 	ACTUAL,
@@ -19,4 +21,12 @@ struct Document {
 	int rating = 0;
 };
 
+// Input of SearchServer::AddDocuments; the text must outlive the call
+struct RawDocument {
+	int id = 0;
+	std::string_view text;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "document.h"
+
+const size_t DOCUMENT_STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1U;
+
+// Rating and status of every document by dense internal id, stored in columns: a rating
+// array and one bitset per DocumentStatus, so a status filter tests a single bit.
+class DocumentAttributes {
+public:
+	// Internal ids are handed out in ascending order, so the columns grow at the end
+	void Add(int internal_id, int rating, DocumentStatus status);
+
+	void Remove(int internal_id);
+
+	// Number of documents added and not removed
+	size_t GetSize() const;
+
+	// The getters below expect a present document
+
+	int GetRating(int internal_id) const {
+		return ratings_[internal_id];
+	}
+
+	DocumentStatus GetStatus(int internal_id) const;
+
+	bool HasStatus(int internal_id, DocumentStatus status) const {
+		return (status_bits_[static_cast<size_t>(status)][internal_id / 64] >> (internal_id % 64)) & 1U;
+	}
+
+private:
+	std::vector<int> ratings_;
+	std::vector<uint64_t> status_bits_[DOCUMENT_STATUS_COUNT];
+	size_t size_ = 0;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "paginator.h"
+
+// Binary index file written by SearchServer::Save. The file is a header followed by
+// plain arrays in native byte order, each aligned to 8 bytes, so a memory-mapped file
+// can be read in place.
+const char INDEX_FILE_MAGIC[8] = {'S', 'E', 'I', 'N', 'D', 'E', 'X', '\0'};
+
+const uint32_t INDEX_FILE_VERSION = 2;
+
+// Stored in every file; reads differently on a machine of other byte order
+const uint32_t INDEX_FILE_BYTE_ORDER = 0x01020304;
+
+// Location of one array: byte offset from the start of the file and element count
+struct FileSection {
+	uint64_t offset = 0;
+	uint64_t count = 0;
+};
+
+struct IndexFileHeader {
+	char magic[8] = {};
+	uint32_t version = 0;
+	uint32_t byte_order = 0;
+	// Strings are stored as count + 1 offsets into a text blob
+	FileSection stop_word_offsets;
+	FileSection stop_word_text;
+	// Terms are sorted, term id i is the i-th term
+	FileSection term_offsets;
+	FileSection term_text;
+	// Arrays of one compressed segment (see ImmutableSegment::Layout)
+	FileSection posting_offsets;
+	FileSection block_offsets;
+	FileSection posting_blocks;
+	FileSection packed_postings;
+	FileSection term_freqs;
+	FileSection posting_document_ids;
+	// Documents sorted by id and their term lists back to back
+	FileSection documents;
+	FileSection document_term_offsets;
+	FileSection document_terms;
+};
+
+struct DocumentRecord {
+	int32_t id;
+	int32_t rating;
+	int32_t status;
+	int32_t reserved;
+};
+
+// Read-only contents of a whole file, memory-mapped where the platform supports it
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	const char* GetData() const;
+
+	size_t GetSize() const;
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+	// Holds the contents when the file is read instead of mapped
+	std::vector<char> buffer_;
+};
+
+[[noreturn]] void ThrowCorruptedIndexFile();
+
+// Validates the header of a mapped index file
+IndexFileHeader ReadIndexFileHeader(const MappedFile& file);
+
+// Returns the array a section describes after checking it lies inside the file
+template <typename T>
+const T* GetSectionData(const MappedFile& file, FileSection section) {
+	const bool is_valid = section.offset <= file.GetSize()
+		&& section.offset % alignof(T) == 0U
+		&& section.count <= (file.GetSize() - section.offset) / sizeof(T);
+	if (!is_valid) {
+		ThrowCorruptedIndexFile();
+	}
+
+	return reinterpret_cast<const T*>(file.GetData() + section.offset);
+}
+
+// Same, as a range of the section's elements
+template <typename T>
+IteratorRange<const T*> MakeSectionRange(const MappedFile& file, FileSection section) {
+	const T* data = GetSectionData<T>(file, section);
+
+	return {data, data + section.count};
+}
+
+// Same for a section of offsets, which must start at zero, never decrease and end at end_value
+const uint64_t* GetOffsetsData(const MappedFile& file, FileSection section, uint64_t end_value);
+
+// Writes an index file: arrays first, the header last, once their locations are known
+// Writes next to the target and renames over it in Finish, so readers of the old file,
+// including servers mapping it, are never affected and a failed write leaves it intact
+class IndexFileWriter {
+public:
+	explicit IndexFileWriter(const std::string& path);
+
+	IndexFileWriter(const IndexFileWriter&) = delete;
+
+	IndexFileWriter& operator=(const IndexFileWriter&) = delete;
+
+	// Removes the temporary file unless Finish succeeded
+	~IndexFileWriter();
+
+	template <typename T>
+	FileSection Write(const std::vector<T>& values) {
+		return WriteBytes(values.data(), values.size(), sizeof(T));
+	}
+
+	template <typename T>
+	FileSection Write(IteratorRange<const T*> values) {
+		return WriteBytes(values.begin(), values.size(), sizeof(T));
+	}
+
+	// Returns the sections of the offsets and of the text
+	std::pair<FileSection, FileSection> WriteStrings(const std::vector<std::string_view>& strings);
+
+	// Writes the header, flushes the file to disk and replaces the target with it
+	void Finish(IndexFileHeader header);
+
+private:
+	std::string path_;
+	std::string temporary_path_;
+	std::ofstream out_;
+	uint64_t position_ = 0;
+	bool is_finished_ = false;
+
+	FileSection WriteBytes(const void* data, size_t count, size_t element_size);
+};
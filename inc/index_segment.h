@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "paginator.h"
+#include "term_dictionary.h"
+
+struct Posting {
+	int document_id;
+	double term_freq;
+};
+
+// Postings of one term, contiguous and sorted by document id
+using PostingList = std::vector<Posting>;
+
+using PostingRange = IteratorRange<const Posting*>;
+
+using DeletedDocuments = std::unordered_set<int>;
+
+PostingRange MakePostingRange(const PostingList& postings);
+
+// Returns the end of the range if the document has no posting
+const Posting* FindPosting(PostingRange postings, int document_id);
+
+// Postings whose document id lies in [first_document_id, last_document_id)
+PostingRange SlicePostings(PostingRange postings, int64_t first_document_id, int64_t last_document_id);
+
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Header and skip entry of a block of up to POSTING_BLOCK_SIZE postings of one term.
+// The block stores gaps between document ids minus one, bit-packed with a common width,
+// followed by bit-packed indexes into the distinct term frequencies of the block.
+struct PostingBlock {
+	int first_document_id;
+	int last_document_id;
+	// Position of the packed data, in 64-bit words
+	uint64_t data_offset;
+	// Position of the distinct term frequencies, sorted ascending
+	uint64_t term_freq_offset;
+	uint16_t posting_count;
+	uint16_t term_freq_count;
+	uint8_t gap_bits;
+	uint8_t term_freq_bits;
+	uint16_t reserved;
+};
+
+// Read-only segment: compressed posting rows of all terms stored back to back.
+// Segments are never modified after construction and may be shared between threads.
+class ImmutableSegment {
+public:
+	struct MergeInput {
+		std::shared_ptr<const ImmutableSegment> segment;
+		DeletedDocuments deleted;
+	};
+
+	// Arrays of a segment, whether built in memory or mapped from an index file
+	struct Layout {
+		// Number of postings before the row of each term, term bound + 1 values
+		IteratorRange<const uint64_t*> posting_offsets;
+		// Index of the first block of each term, term bound + 1 values
+		IteratorRange<const uint64_t*> block_offsets;
+		IteratorRange<const PostingBlock*> blocks;
+		IteratorRange<const uint64_t*> packed_data;
+		IteratorRange<const double*> term_freqs;
+		// Sorted ids of documents having at least one posting here
+		IteratorRange<const int*> document_ids;
+	};
+
+	// Seals the rows of a mutable segment, rows[term_id] sorted by document id
+	explicit ImmutableSegment(const std::vector<PostingList>& rows);
+
+	// Merges several segments, dropping postings of deleted documents
+	explicit ImmutableSegment(const std::vector<MergeInput>& inputs);
+
+	// Views arrays stored elsewhere, e.g. in a mapped index file; storage keeps them alive
+	ImmutableSegment(std::shared_ptr<const void> storage, const Layout& layout);
+
+	// Calls callback(posting) for postings of the term with document ids in
+	// [first_document_id, last_document_id); blocks outside the range are not decoded
+	template <typename Callback>
+	void ForEachPosting(TermId term_id, int64_t first_document_id, int64_t last_document_id, Callback callback) const {
+		if (term_id >= GetTermBound()) {
+			return;
+		}
+
+		const PostingBlock* block = FindBlock(term_id, first_document_id);
+		const PostingBlock* const last_block = layout_.blocks.begin() + layout_.block_offsets.begin()[term_id + 1U];
+		int document_ids[POSTING_BLOCK_SIZE];
+		double term_freqs[POSTING_BLOCK_SIZE];
+		for (; block != last_block && block->first_document_id < last_document_id; ++block) {
+			DecodeBlock(*block, document_ids, term_freqs);
+			for (size_t i = 0; i < block->posting_count; ++i) {
+				if (document_ids[i] >= first_document_id && document_ids[i] < last_document_id) {
+					callback(Posting{document_ids[i], term_freqs[i]});
+				}
+			}
+		}
+	}
+
+	// Seeks with the skip entries and decodes document ids of one block at most
+	bool HasPosting(TermId term_id, int document_id) const;
+
+	bool HasDocument(int document_id) const;
+
+	size_t GetPostingCount(TermId term_id) const;
+
+	size_t GetPostingCount() const;
+
+	size_t GetDocumentCount() const;
+
+	// Upper bound of term ids having postings here
+	size_t GetTermBound() const;
+
+	const Layout& GetLayout() const;
+
+	// Blocks of the term in document id order, empty past the term bound
+	IteratorRange<const PostingBlock*> GetBlocks(TermId term_id) const;
+
+	// Largest term frequency of the block
+	double GetMaxTermFreq(const PostingBlock& block) const;
+
+	// Decodes all postings of the block into arrays of POSTING_BLOCK_SIZE elements
+	void DecodeBlock(const PostingBlock& block, int* document_ids, double* term_freqs) const;
+
+	// Whether the blocks agree with the offsets and stay inside the arrays
+	bool IsConsistent() const;
+
+private:
+	// Compresses rows one after another into arrays owned by the segment
+	class Encoder;
+
+	// Keeps the arrays of the layout alive, whether they are owned or viewed
+	std::shared_ptr<const void> storage_;
+	Layout layout_;
+
+	// First block of the term whose last document id is not below document_id
+	const PostingBlock* FindBlock(TermId term_id, int64_t document_id) const;
+
+	void DecodeDocumentIds(const PostingBlock& block, int* document_ids) const;
+};
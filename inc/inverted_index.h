@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "index_file.h"
+#include "index_segment.h"
+#include "posting_cursor.h"
+#include "term_dictionary.h"
+
+struct SegmentPolicy {
+	// The mutable segment is sealed once it holds this many postings
+	size_t mutable_posting_limit = 1U << 16U;
+	// This many sealed segments of one size tier are merged into one
+	size_t merge_factor = 4U;
+	// Merge on a worker thread instead of inside the writing call
+	bool background_merges = true;
+};
+
+class InvertedIndex;
+
+// One segment as seen by document-at-a-time evaluation. All live postings of a document
+// are in one segment, so documents can be scored segment by segment.
+class SegmentView {
+public:
+	void OpenCursor(TermId term_id, PostingCursor& cursor) const;
+
+	bool Contains(TermId term_id, int document_id) const;
+
+	// Whether the postings of the document here belong to a removed document
+	bool IsDeleted(int document_id) const;
+
+private:
+	friend class InvertedIndex;
+
+	const InvertedIndex* index_ = nullptr;
+	// Null for the mutable segment
+	const ImmutableSegment* segment_ = nullptr;
+	const DeletedDocuments* deleted_ = nullptr;
+};
+
+// Term dictionary plus postings organized as segments: a small mutable segment
+// receiving new documents and a set of sealed, read-optimized immutable segments
+// that are compacted by a tiered merge policy. Every segment is indexed by the
+// same global term ids.
+class InvertedIndex {
+public:
+	InvertedIndex() = default;
+
+	// Copies share the sealed segments; merges still running belong to the original only
+	InvertedIndex(const InvertedIndex& other);
+
+	InvertedIndex(InvertedIndex&& other) noexcept;
+
+	// Serves terms and postings straight from a mapped index file written by Save
+	InvertedIndex(const std::shared_ptr<const MappedFile>& file, const IndexFileHeader& header);
+
+	InvertedIndex& operator=(InvertedIndex&& other) noexcept;
+
+	TermId AddTerm(std::string_view term);
+
+	// Drops a term that no live document contains, freeing its text
+	void RemoveTerm(TermId term_id);
+
+	TermId FindTerm(std::string_view term) const;
+
+	std::string_view GetTerm(TermId term_id) const;
+
+	size_t GetTermCount() const;
+
+	TermMemoryUsage GetTermMemoryUsage() const;
+
+	void AddPosting(TermId term_id, int document_id, double term_freq);
+
+	// Adds postings sorted by document id for documents not yet in the index
+	void AddPostings(TermId term_id, const PostingList& postings);
+
+	// Removes the posting from the mutable segment; sealed segments are handled by DeleteDocument
+	void RemovePosting(TermId term_id, int document_id);
+
+	// Hides all postings of the document in sealed segments
+	void DeleteDocument(int document_id);
+
+	// Number of live documents containing the term
+	size_t GetDocumentFreq(TermId term_id) const;
+
+	// Upper bound of the term frequencies of the term in all segments
+	double GetMaxTermFreq(TermId term_id) const;
+
+	bool Contains(TermId term_id, int document_id) const;
+
+	// Calls callback(posting) for every live posting of the term
+	template <typename Callback>
+	void ForEachPosting(TermId term_id, Callback callback) const {
+		ForEachPosting(term_id, INT64_MIN, INT64_MAX, callback);
+	}
+
+	// Same, restricted to document ids in [first_document_id, last_document_id)
+	template <typename Callback>
+	void ForEachPosting(TermId term_id, int64_t first_document_id, int64_t last_document_id, Callback callback) const {
+		for (const SealedSegment& sealed : sealed_) {
+			const bool has_deleted = !sealed.deleted.empty();
+			sealed.segment->ForEachPosting(term_id, first_document_id, last_document_id, [&callback, &sealed, has_deleted](const Posting& posting) {
+				if (!has_deleted || sealed.deleted.count(posting.document_id) == 0U) {
+					callback(posting);
+				}
+			});
+		}
+		for (const Posting& posting : SlicePostings(GetMutablePostings(term_id), first_document_id, last_document_id)) {
+			callback(posting);
+		}
+	}
+
+	// Calls visitor(segment) with a SegmentView of every segment holding postings
+	template <typename Visitor>
+	void ForEachSegment(Visitor visitor) const {
+		SegmentView view;
+		view.index_ = this;
+		for (const SealedSegment& sealed : sealed_) {
+			view.segment_ = sealed.segment.get();
+			view.deleted_ = &sealed.deleted;
+			visitor(static_cast<const SegmentView&>(view));
+		}
+		if (mutable_posting_count_.load(std::memory_order_relaxed) > 0U) {
+			view.segment_ = nullptr;
+			view.deleted_ = nullptr;
+			visitor(static_cast<const SegmentView&>(view));
+		}
+	}
+
+	// Roughly evenly spaced ids of documents containing the term, ascending
+	std::vector<int> SampleDocumentIds(TermId term_id, size_t sample_count) const;
+
+	void SetSegmentPolicy(const SegmentPolicy& policy);
+
+	// Seals the mutable segment when it is full and installs finished merges
+	void Maintain();
+
+	// Seals the mutable segment regardless of its size
+	void Flush();
+
+	// Blocks until all merges the policy asks for are done and installed
+	void WaitForMerges();
+
+	size_t GetSegmentCount() const;
+
+	// Gives every document with live postings the id new_document_ids[id], keeping their order,
+	// and seals all live postings into one segment. Pending merges are dropped.
+	void RenumberDocuments(const std::vector<int>& new_document_ids);
+
+	// Writes live terms in sorted order with their postings, compressed as one sealed
+	// segment, and fills the matching header sections. Terms are renumbered by their order;
+	// returns the new id of every old id, NO_TERM for free ids. Postings take their document
+	// ids from new_document_ids.
+	std::vector<TermId> Save(IndexFileWriter& writer, IndexFileHeader& header, const std::vector<int>& new_document_ids) const;
+
+private:
+	friend class SegmentView;
+
+	struct SealedSegment {
+		std::shared_ptr<const ImmutableSegment> segment;
+		DeletedDocuments deleted;
+	};
+
+	struct PendingMerge {
+		std::vector<ImmutableSegment::MergeInput> inputs;
+		std::future<std::shared_ptr<const ImmutableSegment>> result;
+	};
+
+	TermDictionary terms_;
+	std::vector<size_t> document_freqs_;
+	// Mutable segment: one growable row per term id
+	std::vector<PostingList> postings_;
+	// Upper bound of the term frequencies of each mutable row; removals do not lower it
+	std::vector<double> max_term_freqs_;
+	// Parallel AddPostings and RemovePosting calls on distinct terms update it concurrently
+	std::atomic<size_t> mutable_posting_count_ = 0;
+	std::vector<SealedSegment> sealed_;
+	std::vector<PendingMerge> pending_merges_;
+	SegmentPolicy policy_;
+
+	PostingRange GetMutablePostings(TermId term_id) const;
+
+	void InstallMerges(bool wait);
+
+	void ScheduleMerges();
+
+	size_t GetSizeTier(const ImmutableSegment& segment) const;
+
+	bool IsMerging(const ImmutableSegment* segment) const;
+};
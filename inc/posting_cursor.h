@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+#include "index_segment.h"
+
+// Walks the postings of one term in one segment in document id order, for
+// document-at-a-time evaluation. Compressed rows are decoded one block at a time;
+// block headers let the cursor skip blocks and bound the term frequencies inside them.
+class PostingCursor {
+public:
+	// Document id of an exhausted cursor
+	static constexpr int64_t END = INT64_MAX;
+
+	// Positions the cursor on the first posting of a compressed row
+	void Open(const ImmutableSegment& segment, TermId term_id);
+
+	// Same for a plain row whose term frequencies do not exceed max_term_freq
+	void Open(PostingRange postings, double max_term_freq);
+
+	int64_t GetDocumentId() const {
+		return document_id_;
+	}
+
+	double GetTermFreq() const {
+		return segment_ == nullptr ? postings_.begin()[position_].term_freq : term_freqs_[position_];
+	}
+
+	// Upper bound of the term frequencies of the whole row
+	double GetMaxTermFreq() const {
+		return max_term_freq_;
+	}
+
+	void Next() {
+		++position_;
+		if (position_ < position_count_) {
+			document_id_ = segment_ == nullptr ? postings_.begin()[position_].document_id : document_ids_[position_];
+		} else if (segment_ == nullptr) {
+			document_id_ = END;
+		} else {
+			++block_;
+			DecodeBlock();
+		}
+	}
+
+	// Moves to the first posting with a document id not below document_id; never moves back
+	void Seek(int64_t document_id);
+
+	// Moves to the block that would hold document_id without decoding it and returns the
+	// upper bound of its term frequencies, zero past the row. A plain row is one block.
+	double SeekBlock(int64_t document_id);
+
+	// Last document id of the block found by SeekBlock
+	int64_t GetBlockLastDocumentId() const;
+
+private:
+	const ImmutableSegment* segment_ = nullptr;
+	PostingRange postings_;
+	double max_term_freq_ = 0.0;
+	int64_t document_id_ = END;
+	size_t position_ = 0;
+	size_t position_count_ = 0;
+
+	// Blocks of a compressed row: the decoded one and the one SeekBlock looked at
+	const PostingBlock* block_ = nullptr;
+	const PostingBlock* shallow_block_ = nullptr;
+	const PostingBlock* last_block_ = nullptr;
+	int document_ids_[POSTING_BLOCK_SIZE];
+	double term_freqs_[POSTING_BLOCK_SIZE];
+
+	void DecodeBlock();
+};
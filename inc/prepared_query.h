@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "term_dictionary.h"
+
+class SearchServer;
+
+// A query parsed once and resolved against the index of one SearchServer.
+// It stays valid until a document is added to or removed from that server.
+struct PreparedQuery {
+	struct PlusTerm {
+		TermId term_id;
+		// Points into the server dictionary, not into the raw query
+		std::string_view word;
+		double inverse_document_freq;
+		// Live documents of the server containing the word
+		size_t document_freq;
+	};
+
+	// Sorted by word and deduplicated; words absent from the index are dropped
+	std::vector<PlusTerm> plus_terms;
+	std::vector<TermId> minus_terms;
+
+	const SearchServer* server = nullptr;
+	uint64_t generation = 0;
+};
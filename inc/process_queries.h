@@ -1,10 +1,37 @@
 #pragma once
 
+#include "paginator.h"
 #include "search_server.h"
 
 #include <string>
 #include <vector>
 
+// Results of a batch of queries stored back to back in one buffer
+struct QueryBatchResults {
+	std::vector<Document> documents;
+	// Results of query i are documents[offsets[i], offsets[i + 1]); one more value than queries
+	std::vector<size_t> offsets = {0U};
+
+	size_t GetQueryCount() const {
+		return offsets.size() - 1U;
+	}
+
+	IteratorRange<std::vector<Document>::const_iterator> GetResults(size_t query_index) const {
+		return {documents.begin() + offsets[query_index], documents.begin() + offsets[query_index + 1U]};
+	}
+};
+
+// Searches ACTUAL documents for a batch of queries. Identical queries are evaluated once;
+// queries sharing their longest posting list are evaluated together so that the list is
+// read once for the group, and the remaining queries are searched separately in parallel.
+QueryBatchResults ProcessQueryBatch(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+QueryBatchResults ProcessQueryBatch(const SearchServer& search_server, const std::vector<PreparedQuery>& queries);
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
 
-std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
\ No newline at end of file
+std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<PreparedQuery>& queries);
+
+std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<PreparedQuery>& queries);
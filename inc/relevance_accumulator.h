@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Relevance sums of candidate documents over one range of document ids. A query matching a
+// large share of the range sums into a dense array indexed by document id, a selective one
+// into an open addressing table. Both keep their memory when reset, so once they have grown
+// to the query sizes, queries do not allocate.
+class RelevanceAccumulator {
+public:
+	// Ranges at most this many times larger than the expected number of documents are dense
+	static constexpr size_t DENSE_RANGE_RATIO = 8;
+
+	// Forgets all sums and picks the layout for documents in [first_document_id,
+	// last_document_id), expected_count of which are expected to be added. Costs time
+	// proportional to the number of documents added since the last reset.
+	void Reset(int first_document_id, int last_document_id, size_t expected_count) {
+		Clear();
+		first_document_id_ = first_document_id;
+		const size_t range_size = last_document_id > first_document_id ? static_cast<size_t>(last_document_id - first_document_id) : 0U;
+		is_dense_ = range_size <= expected_count * DENSE_RANGE_RATIO;
+		if (is_dense_ && dense_relevance_.size() < range_size) {
+			dense_relevance_.resize(range_size);
+			dense_states_.resize(range_size);
+		}
+	}
+
+	bool IsDense() const {
+		return is_dense_;
+	}
+
+	void Add(int document_id, double relevance) {
+		if (is_dense_) {
+			const size_t index = static_cast<size_t>(document_id - first_document_id_);
+			if (dense_states_[index] == UNTOUCHED) {
+				dense_states_[index] = ADDED;
+				touched_.push_back(document_id);
+			}
+			dense_relevance_[index] += relevance;
+			return;
+		}
+		slots_[InsertSlot(document_id)].relevance += relevance;
+	}
+
+	// Drops the document from the results; later additions to it are ignored too
+	void Exclude(int document_id) {
+		if (is_dense_) {
+			const size_t index = static_cast<size_t>(document_id - first_document_id_);
+			if (dense_states_[index] == UNTOUCHED) {
+				touched_.push_back(document_id);
+			}
+			dense_states_[index] = EXCLUDED;
+			return;
+		}
+		Slot& slot = slots_[InsertSlot(document_id)];
+		slot.is_excluded = true;
+	}
+
+	// Calls visitor(document_id, relevance) for every document not excluded
+	template <typename Visitor>
+	void ForEach(Visitor visitor) const {
+		for (const int document_id : touched_) {
+			const size_t index = static_cast<size_t>(document_id - first_document_id_);
+			if (dense_states_[index] == ADDED) {
+				visitor(document_id, dense_relevance_[index]);
+			}
+		}
+		for (const uint32_t index : used_slots_) {
+			const Slot& slot = slots_[index];
+			if (!slot.is_excluded) {
+				visitor(slot.document_id, slot.relevance);
+			}
+		}
+	}
+
+	// Costs time proportional to the number of documents added since the last reset
+	void Clear() {
+		for (const int document_id : touched_) {
+			const size_t index = static_cast<size_t>(document_id - first_document_id_);
+			dense_relevance_[index] = 0.0;
+			dense_states_[index] = UNTOUCHED;
+		}
+		touched_.clear();
+		for (const uint32_t index : used_slots_) {
+			slots_[index] = Slot();
+		}
+		used_slots_.clear();
+	}
+
+private:
+	// Document ids are never negative
+	static constexpr int EMPTY = -1;
+	static constexpr size_t MIN_CAPACITY = 64;
+
+	enum : uint8_t { UNTOUCHED, ADDED, EXCLUDED };
+
+	struct Slot {
+		int document_id = EMPTY;
+		bool is_excluded = false;
+		double relevance = 0.0;
+	};
+
+	bool is_dense_ = false;
+
+	// Dense layout: sums and states of the documents from first_document_id_ on
+	int first_document_id_ = 0;
+	std::vector<double> dense_relevance_;
+	std::vector<uint8_t> dense_states_;
+	// Ids of added documents in insertion order
+	std::vector<int> touched_;
+
+	// Sparse layout
+	std::vector<Slot> slots_;
+	// Indexes of occupied slots in insertion order
+	std::vector<uint32_t> used_slots_;
+	// 64 minus log2 of the capacity
+	unsigned shift_ = 64;
+
+	size_t FindSlot(int document_id) const {
+		const size_t mask = slots_.size() - 1U;
+		size_t index = static_cast<size_t>((static_cast<uint64_t>(document_id) * 0x9e3779b97f4a7c15ULL) >> shift_);
+		while (slots_[index].document_id != EMPTY && slots_[index].document_id != document_id) {
+			index = (index + 1U) & mask;
+		}
+
+		return index;
+	}
+
+	// Index of the slot of the document, occupying a free one if it has none
+	size_t InsertSlot(int document_id) {
+		if ((used_slots_.size() + 1U) * 2U > slots_.size()) {
+			Rehash(slots_.empty() ? MIN_CAPACITY : slots_.size() * 2U);
+		}
+		const size_t index = FindSlot(document_id);
+		if (slots_[index].document_id == EMPTY) {
+			slots_[index].document_id = document_id;
+			used_slots_.push_back(static_cast<uint32_t>(index));
+		}
+
+		return index;
+	}
+
+	void Rehash(size_t capacity) {
+		std::vector<Slot> old_slots(capacity);
+		old_slots.swap(slots_);
+		std::vector<uint32_t> old_used_slots;
+		old_used_slots.swap(used_slots_);
+		used_slots_.reserve(capacity / 2U);
+		shift_ = 64U;
+		for (size_t size = capacity; size > 1U; size /= 2U) {
+			--shift_;
+		}
+		for (const uint32_t old_index : old_used_slots) {
+			const size_t index = FindSlot(old_slots[old_index].document_id);
+			slots_[index] = old_slots[old_index];
+			used_slots_.push_back(static_cast<uint32_t>(index));
+		}
+	}
+};
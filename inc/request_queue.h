@@ -1,17 +1,52 @@
 #pragma once
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 
+#include "cache_line.h"
 #include "search_server.h"
 
+struct RequestWindowOptions {
+	// Requests older than this are forgotten
+	std::chrono::steady_clock::duration window = std::chrono::hours(24);
+	// The window slides by window / bucket_count
+	size_t bucket_count = 144;
+};
+
+// Request latencies in microseconds: bucket 0 counts latencies under 1, bucket i latencies
+// in [2^(i - 1), 2^i), the last one everything longer
+const size_t LATENCY_BUCKET_COUNT = 16;
+
+struct RequestStats {
+	uint64_t request_count = 0;
+	uint64_t no_result_count = 0;
+	std::array<uint64_t, LATENCY_BUCKET_COUNT> latency_counts = {};
+};
+
+// Searches on behalf of many threads and keeps statistics of the requests of a sliding
+// wall-clock window. Every thread counts into its own ring of time buckets, registered
+// when it first records a request, so recording takes no locks and loses no counts;
+// readers sum up the rings. Rings live as long as the queue; a thread forgets the rings
+// of destroyed queues the next time it looks up a ring.
 class RequestQueue {
 public:
-	explicit RequestQueue(const SearchServer& search_server);
+	using Clock = std::chrono::steady_clock;
+
+	explicit RequestQueue(const SearchServer& search_server, const RequestWindowOptions& options = RequestWindowOptions());
+
+	RequestQueue(const RequestQueue&) = delete;
+
+	RequestQueue& operator=(const RequestQueue&) = delete;
 
 	template <typename DocumentPredicate>
 	std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-		const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-		AddRequest(result.size());
+		const Clock::time_point start = Clock::now();
+		auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
+		const Clock::time_point end = Clock::now();
+		RecordRequest(result.size(), end - start, end);
 
 		return result;
 	}
@@ -20,18 +55,63 @@ public:
 
 	std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+	// Counts a request that finished at the given time
+	void RecordRequest(size_t result_count, Clock::duration latency, Clock::time_point finish_time);
+
+	// Statistics of the whole window
+	RequestStats GetStats() const;
+
+	// Statistics of the last window length, rounded up to buckets and at most the whole window
+	RequestStats GetStats(Clock::duration window, Clock::time_point now = Clock::now()) const;
+
 	int GetNoResultRequests() const;
 
+	// Number of queues the calling thread keeps a ring of, destroyed ones not yet forgotten included
+	static size_t GetThreadRingCount();
+
 private:
-	struct QueryResult {
-		uint64_t timestamp;
-		int results;
+	// Written by the owning thread only
+	struct alignas(CACHE_LINE_SIZE) Bucket {
+		// Number of the time bucket counted here plus one, zero while unused
+		std::atomic<uint64_t> epoch = 0;
+		std::atomic<uint64_t> request_count = 0;
+		std::atomic<uint64_t> no_result_count = 0;
+		std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> latency_counts = {};
 	};
-	std::deque<QueryResult> requests_;
+
+	// Ring of bucket_count_ buckets of one thread
+	struct Ring {
+		std::unique_ptr<Bucket[]> buckets;
+		// Rings are pushed to the front of the list and never removed before destruction
+		Ring* next = nullptr;
+	};
+
+	// Rings of all threads; threads hold weak references to tell destroyed queues
+	struct RingList {
+		std::atomic<Ring*> head = nullptr;
+
+		~RingList();
+	};
+
+	// Ring of a queue as remembered by one thread
+	struct ThreadRing {
+		uint64_t queue_id;
+		std::weak_ptr<const RingList> owner;
+		Ring* ring;
+	};
+
 	const SearchServer& search_server_;
-	int no_results_requests_;
-	uint64_t current_time_;
-	const static int sec_in_day_ = 1440;
+	Clock::duration bucket_width_;
+	size_t bucket_count_;
+	// Tells the rings of this queue apart from those of other queues in thread_local lookups
+	uint64_t queue_id_;
+	std::shared_ptr<RingList> rings_;
+
+	static std::vector<ThreadRing>& GetThreadRings();
+
+	Ring& GetThreadRing();
+
+	uint64_t GetEpoch(Clock::time_point time) const;
 
-	void AddRequest(int results_num);
-};
\ No newline at end of file
+	static size_t GetLatencyBucket(Clock::duration latency);
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "prepared_query.h"
+
+struct ResultCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	size_t size = 0;
+};
+
+// Thread-safe LRU cache of search results keyed by normalized query and status. Every
+// entry is tagged with the generation of the index it was computed on; a lookup under
+// another generation misses and drops the entry. The entries are spread over shards
+// with separate locks, each evicting its least recently used entry when full.
+class ResultCache {
+public:
+	using Key = std::vector<uint32_t>;
+
+	explicit ResultCache(size_t capacity);
+
+	// Plus terms of a prepared query are already sorted by word and minus terms by id,
+	// so equal queries up to word order, repeats and stop words get equal keys
+	static void MakeKey(const PreparedQuery& query, DocumentStatus status, Key& key);
+
+	// Copies the cached results into result, reusing its memory
+	bool Find(const Key& key, uint64_t generation, std::vector<Document>& result);
+
+	void Insert(const Key& key, uint64_t generation, const std::vector<Document>& documents);
+
+	void Clear();
+
+	size_t GetCapacity() const;
+
+	ResultCacheStats GetStats() const;
+
+private:
+	static constexpr size_t MAX_SHARD_COUNT = 16;
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	struct Entry {
+		Key key;
+		uint64_t generation;
+		std::vector<Document> documents;
+	};
+
+	struct Shard {
+		std::mutex mutex;
+		size_t capacity = 0;
+		// Most recently used first
+		std::list<Entry> entries;
+		std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> positions;
+	};
+
+	size_t capacity_;
+	std::unique_ptr<Shard[]> shards_;
+	size_t shard_count_;
+	std::atomic<uint64_t> hits_ = 0;
+	std::atomic<uint64_t> misses_ = 0;
+
+	Shard& GetShard(const Key& key);
+};
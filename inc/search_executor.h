@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+#include "work_stealing_pool.h"
+
+struct SearchExecutorOptions {
+	// Zero starts one worker per hardware thread
+	size_t thread_count = 0;
+	// Queries accepted but not answered yet; further queries are rejected
+	size_t max_pending_queries = 1024;
+	// Queries scoring at least this many postings are split into ranges searched in parallel
+	size_t split_posting_count = 1U << 16U;
+	// Ranges of a split query per worker
+	size_t ranges_per_thread = 2;
+};
+
+struct SearchExecutorStats {
+	uint64_t accepted = 0;
+	uint64_t rejected = 0;
+	uint64_t split = 0;
+};
+
+// Error of a query the executor had no room for
+class QueryRejectedError : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+// Answers queries asynchronously on a bounded work-stealing pool. Every query runs as one
+// sequential search, so requests overlap without nested parallel algorithms; queries with
+// many postings are split into id ranges searched as separate tasks and merged by the last
+// one. When max_pending_queries are in flight, new queries are shed at once instead of
+// queueing up. The server must not be modified while queries are pending.
+class SearchExecutor {
+public:
+	// Receives the results, or the error and no results
+	using Callback = std::function<void(std::vector<Document> documents, std::exception_ptr error)>;
+
+	explicit SearchExecutor(const SearchServer& search_server, const SearchExecutorOptions& options = SearchExecutorOptions());
+
+	SearchExecutor(const SearchExecutor&) = delete;
+
+	SearchExecutor& operator=(const SearchExecutor&) = delete;
+
+	// The future of a rejected query holds a QueryRejectedError
+	std::future<std::vector<Document>> Submit(std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+	// Calls callback on a worker thread once the query is answered; the callback must not
+	// throw. Returns false without calling it if the query is rejected.
+	bool Submit(std::string raw_query, DocumentStatus status, Callback callback);
+
+	size_t GetPendingQueryCount() const;
+
+	SearchExecutorStats GetStats() const;
+
+private:
+	struct SplitQuery;
+
+	const SearchServer& search_server_;
+	SearchExecutorOptions options_;
+	std::atomic<size_t> pending_count_ = 0;
+	std::atomic<uint64_t> accepted_count_ = 0;
+	std::atomic<uint64_t> rejected_count_ = 0;
+	std::atomic<uint64_t> split_count_ = 0;
+	// Declared last: its destruction runs the queued tasks before the members above go away
+	WorkStealingPool pool_;
+
+	void RunQuery(const std::string& raw_query, DocumentStatus status, const Callback& callback);
+
+	void RunRange(const std::shared_ptr<SplitQuery>& split, size_t range_index);
+
+	void Finish(const Callback& callback, std::vector<Document> documents, std::exception_ptr error);
+};
@@ -1,23 +1,46 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <set>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <unordered_map>
+#include <type_traits>
 #include <stdexcept>
 #include <algorithm>
 #include <functional>
 #include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <execution>
 
+#include "block_max_wand.h"
+#include "champion_lists.h"
 #include "document.h"
+#include "document_attributes.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "inverted_index.h"
+#include "prepared_query.h"
+#include "relevance_accumulator.h"
+#include "result_cache.h"
+#include "top_documents.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// Predicate of the searches taking a DocumentStatus. Searches recognize it and test
+// the status bitmaps instead of calling it.
+struct DocumentStatusFilter {
+	DocumentStatus status;
+
+	bool operator()(int document_id, DocumentStatus document_status, int rating) const {
+		return document_status == status;
+	}
+};
+
 class SearchServer {
 public:
 	explicit SearchServer(const std::string& stop_words_text);
@@ -31,6 +54,28 @@ public:
 
 	void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+	// Adds a range of RawDocument as one batch: either all documents are added or,
+	// if any id or word is invalid, none of them
+	template <typename DocumentRange>
+	void AddDocuments(const DocumentRange& documents) {
+		AddDocuments(std::execution::seq, documents);
+	}
+
+	template <typename ExecutionPolicy, typename DocumentRange>
+	void AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents) {
+		std::vector<const RawDocument*> batch;
+		for (const RawDocument& document : documents) {
+			batch.push_back(&document);
+		}
+		AddDocumentBatch(batch, std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>);
+	}
+
+	// Parses the query once so it can be executed many times
+	PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+	// Same, reusing the memory of query
+	void PrepareQuery(std::string_view raw_query, PreparedQuery& query) const;
+
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
 		return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
@@ -42,38 +87,135 @@ public:
 
 	template <typename  ExecutionPolicy, typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-		const auto query = ParseQuery(raw_query);
-		auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-		std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-			if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-				return lhs.rating > rhs.rating;
-			} else {
-				return lhs.relevance > rhs.relevance;
-			}
-		}); 
-
-		if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-			matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-		}
-
-		return matched_documents;
+		return FindTopDocuments(policy, PrepareQuery(raw_query), document_predicate);
 	}
 
 	template<typename  ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
-		return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
-		});
+		return FindTopDocuments(policy, PrepareQuery(raw_query), status);
 	}
 
 	template<typename  ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const {
-		return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+		return FindTopDocuments(policy, PrepareQuery(raw_query));
+	}
+
+	template <typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate) const {
+		return FindTopDocuments(std::execution::seq, query, document_predicate);
+	}
+
+	std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const;
+
+	std::vector<Document> FindTopDocuments(const PreparedQuery& query) const;
+
+	template <typename  ExecutionPolicy, typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentPredicate document_predicate) const {
+		CheckPreparedQuery(query);
+		std::vector<Document> result;
+		FindAllDocuments(policy, query, document_predicate, result);
+
+		return result;
+	}
+
+	template<typename  ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status) const {
+		CheckPreparedQuery(query);
+		std::vector<Document> result;
+		FindStatusDocuments(policy, query, status, result);
+
+		return result;
+	}
+
+	template<typename  ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query) const {
+		return FindTopDocuments(policy, query, DocumentStatus::ACTUAL);
+	}
+
+	// Sequential search writing into a caller-provided buffer. Parsing and scoring reuse
+	// memory of the calling thread, so once the buffers have grown to the query sizes no
+	// heap allocation happens. The predicate must not search on the same thread.
+	template <typename DocumentPredicate>
+	void FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, std::vector<Document>& result) const {
+		PreparedQuery& query = GetQueryScratch().query;
+		PrepareQuery(raw_query, query);
+		FindAllDocuments(std::execution::seq, query, document_predicate, result);
 	}
 
+	void FindTopDocuments(std::string_view raw_query, DocumentStatus status, std::vector<Document>& result) const;
+
+	void FindTopDocuments(std::string_view raw_query, std::vector<Document>& result) const;
+
+	template <typename DocumentPredicate>
+	void FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate, std::vector<Document>& result) const {
+		CheckPreparedQuery(query);
+		FindAllDocuments(std::execution::seq, query, document_predicate, result);
+	}
+
+	void FindTopDocuments(const PreparedQuery& query, DocumentStatus status, std::vector<Document>& result) const;
+
+	void FindTopDocuments(const PreparedQuery& query, std::vector<Document>& result) const;
+
+	// Searches ACTUAL documents for several queries in one pass: window by window of document
+	// ids, the postings of every term are read once and added to all queries containing it.
+	// Queries with rows too long for the number of results are searched separately instead.
+	// results[i] receives the results of queries[i].
+	void FindTopDocumentsShared(const std::vector<const PreparedQuery*>& queries, std::vector<std::vector<Document>>& results) const;
+
+	// Number of postings of the plus terms, the work of scoring the query term by term
+	size_t GetPostingCount(const PreparedQuery& query) const;
+
+	// Splits the documents into about range_count ranges holding about the same number of
+	// postings of the query. The bounds are opaque positions for FindRangeDocuments.
+	std::vector<int64_t> SplitDocumentIds(const PreparedQuery& query, size_t range_count) const;
+
+	// Adds the documents of range range_index of the split matching the query and status to
+	// top_documents. Ranges of one split can be searched on different threads and merged,
+	// giving the results of FindTopDocuments; the result cache is not consulted.
+	void FindRangeDocuments(const PreparedQuery& query, DocumentStatus status, const std::vector<int64_t>& bounds, size_t range_index, TopDocuments& top_documents) const;
+
 	int GetDocumentCount() const;
 
+	// Tunes when new documents are sealed into read-optimized segments and how segments are merged
+	void SetSegmentPolicy(const SegmentPolicy& policy);
+
+	// Seals recently added documents into a read-optimized segment
+	void FlushIndex();
+
+	// Blocks until background segment merges are finished
+	void WaitForIndexMerges();
+
+	size_t GetSegmentCount() const;
+
+	// Memory taken by the vocabulary compared with a node-based layout of the same terms
+	TermMemoryUsage GetTermMemoryUsage() const;
+
+	// Read-optimized mode: caches inverse document frequencies and keeps, per term, the
+	// champion_count postings of the highest term frequency. Sequential searches are answered
+	// from these lists when their bound proves the result exact and fall back to the full
+	// rows otherwise. The lists follow added and removed documents; zero turns the mode off.
+	void SetChampionListSize(size_t champion_count);
+
+	// Caches the results of searches by status for up to capacity distinct queries, keyed by
+	// the query terms left after parsing. Adding or removing documents outdates the cached
+	// results. Zero turns the cache off; a copied server starts with an empty cache.
+	void SetResultCacheCapacity(size_t capacity);
+
+	ResultCacheStats GetResultCacheStats() const;
+
+	// Limits the number of documents returned by FindTopDocuments
+	void SetMaxResultDocumentCount(size_t max_result_document_count);
+
+	size_t GetMaxResultDocumentCount() const;
+
+	// Writes stop words, terms, postings and document metadata to a versioned binary file
+	void Save(const std::string& path) const;
+
+	// Opens a file written by Save. Terms and postings are served in place from the
+	// memory-mapped file; only per-document metadata is read into memory. The structure
+	// of the file is checked, its contents are trusted.
+	static SearchServer Load(const std::string& path);
+
 	auto begin() const {
 		return document_ids_.begin();
 	}
@@ -86,16 +228,45 @@ public:
 
 	void RemoveDocument(int document_id);
 
+	// Costs time proportional to the number of distinct words of the document
 	template<typename  ExecutionPolicy>
 	void RemoveDocument(const ExecutionPolicy& policy, int document_id) {
+		const auto internal_id_it = internal_ids_.find(document_id);
+		if (internal_id_it == internal_ids_.end()) {
+			return;
+		}
+		const int internal_id = internal_id_it->second;
+
+		std::vector<TermId> term_ids;
+		term_ids.reserve(document_terms_[internal_id].terms.size());
+		for (const auto& [term_id, _] : document_terms_[internal_id].terms) {
+			term_ids.push_back(term_id);
+		}
+		++generation_;
 		document_ids_.erase(document_id);
-		documents_.erase(document_id);
-		word_to_document_freqs_on_id_.erase(document_id);
+		internal_ids_.erase(internal_id_it);
+		attributes_.Remove(internal_id);
+		document_terms_[internal_id] = DocumentTerms();
+		{
+			std::lock_guard guard(word_frequencies_cache_.mutex);
+			word_frequencies_cache_.documents.erase(document_id);
+		}
+
+		// Every term owns a separate posting list, so they can be updated concurrently
 		for_each(policy,
-				 word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-				 [&document_id](auto& content) {
-					content.second.erase(document_id);
+				 term_ids.begin(), term_ids.end(),
+				 [internal_id, this](TermId term_id) {
+					index_.RemovePosting(term_id, internal_id);
 				});
+		index_.DeleteDocument(internal_id);
+		RemoveFromChampionLists(internal_id, term_ids);
+		for (const TermId term_id : term_ids) {
+			if (index_.GetDocumentFreq(term_id) == 0U) {
+				index_.RemoveTerm(term_id);
+			}
+		}
+		index_.Maintain();
+		CompactInternalIdsIfSparse();
 	}
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
@@ -104,17 +275,79 @@ public:
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const;
 
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const PreparedQuery& query, int document_id) const;
+
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const PreparedQuery& query, int document_id) const;
+
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const PreparedQuery& query, int document_id) const;
+
 private:
-	struct DocumentData {
-		int rating;
-		DocumentStatus status;
-	};
 	const std::set<std::string, std::less<>> stop_words_;
-	std::set<std::string> all_words_;
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-	std::map<int, std::map<std::string_view, double>> word_to_document_freqs_on_id_;
-	std::map<int, DocumentData> documents_;
+	InvertedIndex index_;
+	struct DocumentTerm {
+		TermId term_id;
+		double term_freq;
+	};
+	// Forward index: term frequencies of every document sorted by term id. The lists never
+	// change after AddDocument; they live on the heap or in a mapped index file, and copies
+	// of the server share them.
+	struct DocumentTerms {
+		std::shared_ptr<const void> storage;
+		IteratorRange<const DocumentTerm*> terms;
+	};
+	// Documents are numbered 0, 1, 2... in the order they are added. Postings, the forward
+	// index and the attribute columns use these internal ids, so per-document data lives
+	// in plain arrays. Ids of removed documents are not reused; once they outnumber the live
+	// ones, live documents are renumbered densely.
+	std::unordered_map<int, int> internal_ids_;
+	std::vector<int> external_ids_;
+	// Indexed by internal id; removed documents have an empty list
+	std::vector<DocumentTerms> document_terms_;
+	ChampionLists champion_lists_;
+
+	// GetWordFrequencies builds word maps on demand; a copied server starts with an empty cache
+	struct WordFrequenciesCache {
+		std::mutex mutex;
+		std::map<int, std::map<std::string_view, double>> documents;
+
+		WordFrequenciesCache() = default;
+
+		WordFrequenciesCache(const WordFrequenciesCache&) {
+		}
+
+		WordFrequenciesCache& operator=(const WordFrequenciesCache&) {
+			documents.clear();
+			return *this;
+		}
+	};
+	mutable WordFrequenciesCache word_frequencies_cache_;
+
+	struct ResultCacheHolder {
+		std::unique_ptr<ResultCache> cache;
+
+		ResultCacheHolder() = default;
+
+		ResultCacheHolder(const ResultCacheHolder& other)
+			: cache(other.cache ? std::make_unique<ResultCache>(other.cache->GetCapacity()) : nullptr) {
+		}
+
+		ResultCacheHolder(ResultCacheHolder&&) = default;
+
+		ResultCacheHolder& operator=(const ResultCacheHolder& other) {
+			cache = other.cache ? std::make_unique<ResultCache>(other.cache->GetCapacity()) : nullptr;
+			return *this;
+		}
+
+		ResultCacheHolder& operator=(ResultCacheHolder&&) = default;
+	};
+	ResultCacheHolder result_cache_;
+	// Indexed by internal id
+	DocumentAttributes attributes_;
+	// External ids in ascending order
 	std::set<int> document_ids_;
+	size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+	// Changes whenever the set of documents changes; outdates prepared queries
+	uint64_t generation_ = 0;
 
 	bool IsStopWord(std::string_view word) const;
 
@@ -124,91 +357,226 @@ private:
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
+	static DocumentTerms MakeDocumentTerms(std::vector<DocumentTerm> terms);
+
+	// Returns nullptr if the document does not contain the term
+	static const DocumentTerm* FindDocumentTerm(const DocumentTerms& document_terms, TermId term_id);
+
+	void AddToChampionLists(int internal_id, const DocumentTerms& document_terms);
+
+	void RemoveFromChampionLists(int internal_id, const std::vector<TermId>& term_ids);
+
+	// Throws out_of_range for an unknown document
+	int GetInternalId(int document_id) const;
+
+	// Assigns the next internal id to a new document and returns it
+	int AddInternalId(int document_id);
+
+	// Removed documents are compacted away only when there are this many of them at least
+	static constexpr size_t MIN_COMPACTED_ID_COUNT = 1024;
+
+	// Renumbers live documents 0, 1, 2... in their current order, rebuilding the postings
+	// as one segment. Outdates prepared queries.
+	void CompactInternalIds();
+
+	// Compacts when ids of removed documents outnumber the live ones
+	void CompactInternalIdsIfSparse();
+
+	// Makes room for document_count more internal ids, compacting if the int range runs out
+	void ReserveInternalIds(size_t document_count);
+
+	// Status filters become a bitmap test; other predicates get the attribute columns
+	template <typename DocumentPredicate>
+	bool IsAccepted(DocumentPredicate& document_predicate, int internal_id) const {
+		if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusFilter>) {
+			return attributes_.HasStatus(internal_id, document_predicate.status);
+		} else {
+			return document_predicate(external_ids_[internal_id], attributes_.GetStatus(internal_id), attributes_.GetRating(internal_id));
+		}
+	}
+
+	void AddDocumentBatch(const std::vector<const RawDocument*>& batch, bool parallel);
+
 	struct QueryWord {
 		std::string_view data;
 		bool is_minus;
 		bool is_stop;
 	};
 
-	QueryWord ParseQueryWord(std::string_view text) const;
-
-	struct Query {
-		std::set<std::string_view> plus_words;
-		std::set<std::string_view> minus_words;
+	// Validity comes from the tokenizer, which checks all words in one pass
+	QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
+
+	double ComputeWordInverseDocumentFreq(size_t document_freq) const;
+
+	void CheckPreparedQuery(const PreparedQuery& query) const;
+
+	// Document ids scored together by FindTopDocumentsShared
+	static constexpr int SHARED_SCAN_WINDOW = 1 << 14;
+	// FindTopDocumentsShared scans rows of at most this many postings per requested result
+	static constexpr size_t SHARED_SCAN_ROW_RATIO = 256;
+	// FindTopDocumentsShared skips the rows of non-essential terms of a query only when they
+	// hold this many times more postings than the rows it still reads
+	static constexpr size_t SHARED_SCAN_SKIP_RATIO = 8;
+
+	// Memory reused by the queries of one thread
+	struct QueryScratch {
+		TokenizedText tokens;
+		PreparedQuery query;
+		RelevanceAccumulator accumulator;
+		TopDocuments top_documents{0U};
+		std::vector<TermCursor> cursors;
+		std::vector<TermCursor*> cursor_order;
+		std::vector<int> candidates;
+		std::vector<RelevanceAccumulator> shared_accumulators;
+		std::vector<TopDocuments> shared_tops;
+		std::vector<Posting> shared_postings;
+		ResultCache::Key cache_key;
 	};
 
-	Query ParseQuery(std::string_view text) const;
-	// Existence required
-	double ComputeWordInverseDocumentFreq(std::string_view word) const;
+	static QueryScratch& GetQueryScratch();
 
-	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-		std::map<int, double> document_to_relevance;
+	// Searches by status go through the result cache when it is enabled
+	template <typename ExecutionPolicy>
+	void FindStatusDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status, std::vector<Document>& result) const {
+		ResultCache* cache = result_cache_.cache.get();
+		if (cache == nullptr) {
+			FindAllDocuments(policy, query, DocumentStatusFilter{status}, result);
+			return;
+		}
+		ResultCache::Key& key = GetQueryScratch().cache_key;
+		ResultCache::MakeKey(query, status, key);
+		if (!cache->Find(key, generation_, result)) {
+			FindAllDocuments(policy, query, DocumentStatusFilter{status}, result);
+			cache->Insert(key, generation_, result);
+		}
+	}
 
-		for (std::string_view word : query.plus_words) {
-			if (word_to_document_freqs_.count(word) == 0U) {
+	// Scores the documents on the champion lists of the plus terms exactly. Returns false if a
+	// document outside the lists might still belong to the top results.
+	template <typename DocumentPredicate>
+	bool FindChampionDocuments(const PreparedQuery& query, DocumentPredicate document_predicate, TopDocuments& top_documents) const {
+		std::vector<int>& candidates = GetQueryScratch().candidates;
+		candidates.clear();
+		// Bound of the relevance of documents on none of the lists
+		double bound = 0.0;
+		for (const auto& term : query.plus_terms) {
+			bound += term.inverse_document_freq * champion_lists_.ForEachChampion(index_, term.term_id, [&candidates](int internal_id) {
+				candidates.push_back(internal_id);
+			});
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+		for (const int internal_id : candidates) {
+			const DocumentTerms& document_terms = document_terms_[internal_id];
+			const bool has_minus_word = std::any_of(query.minus_terms.begin(), query.minus_terms.end(), [&document_terms](TermId term_id) {
+				return FindDocumentTerm(document_terms, term_id) != nullptr;
+			});
+			if (has_minus_word || !IsAccepted(document_predicate, internal_id)) {
 				continue;
 			}
-			const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-			for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-				const auto& document_data = documents_.at(document_id);
-				if (document_predicate(document_id, document_data.status, document_data.rating)) {
-					document_to_relevance[document_id] += term_freq * inverse_document_freq;
+			// Same order of additions as the scan of full rows, so the relevance is the same
+			double relevance = 0.0;
+			for (const auto& term : query.plus_terms) {
+				if (const DocumentTerm* document_term = FindDocumentTerm(document_terms, term.term_id)) {
+					relevance += document_term->term_freq * term.inverse_document_freq;
 				}
 			}
+			top_documents.Add({external_ids_[internal_id], relevance, attributes_.GetRating(internal_id)});
 		}
 
-		for (std::string_view word : query.minus_words) {
-			if (word_to_document_freqs_.count(word) == 0U) {
-				continue;
+		return bound < top_documents.GetThreshold();
+	}
+
+	// Document-at-a-time: segment by segment, cursors of the plus terms advance together and
+	// documents that can not reach the current top results are skipped without being scored
+	template <typename DocumentPredicate>
+	void FindAllDocuments(const std::execution::sequenced_policy&, const PreparedQuery& query, DocumentPredicate document_predicate, std::vector<Document>& result) const {
+		QueryScratch& scratch = GetQueryScratch();
+		TopDocuments& top_documents = scratch.top_documents;
+		top_documents.Reset(max_result_document_count_);
+		if (champion_lists_.IsEnabled()) {
+			if (FindChampionDocuments(query, document_predicate, top_documents)) {
+				top_documents.ExtractTo(result);
+				return;
 			}
-			for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-				document_to_relevance.erase(document_id);
+			top_documents.Reset(max_result_document_count_);
+		}
+		std::vector<TermCursor>& cursors = scratch.cursors;
+		cursors.resize(query.plus_terms.size());
+
+		index_.ForEachSegment([&](const SegmentView& segment) {
+			for (size_t i = 0; i < cursors.size(); ++i) {
+				segment.OpenCursor(query.plus_terms[i].term_id, cursors[i].postings);
+				cursors[i].weight = query.plus_terms[i].inverse_document_freq;
 			}
+			RunBlockMaxWand(cursors, scratch.cursor_order, top_documents, [&](int internal_id, double relevance) {
+				if (segment.IsDeleted(internal_id) || !IsAccepted(document_predicate, internal_id)) {
+					return;
+				}
+				for (const TermId term_id : query.minus_terms) {
+					if (segment.Contains(term_id, internal_id)) {
+						return;
+					}
+				}
+				top_documents.Add({external_ids_[internal_id], relevance, attributes_.GetRating(internal_id)});
+			});
+		});
+		top_documents.ExtractTo(result);
+	}
+
+	// Splits the document id space into a few ranges per hardware thread
+	std::vector<int64_t> SplitDocumentIds(const PreparedQuery& query) const;
+
+	// Term-at-a-time scoring of the documents in [bounds[index], bounds[index + 1]). Calls of
+	// different ranges touch disjoint documents, so they can run concurrently without locks.
+	template <typename DocumentPredicate>
+	void FindRangeDocuments(const PreparedQuery& query, DocumentPredicate document_predicate, const std::vector<int64_t>& bounds, size_t index, size_t expected_count, TopDocuments& top_documents) const {
+		// A range body never waits for other tasks, so the worker scratch is not shared
+		RelevanceAccumulator& document_to_relevance = GetQueryScratch().accumulator;
+		const int64_t id_bound = static_cast<int64_t>(external_ids_.size());
+		document_to_relevance.Reset(static_cast<int>(std::clamp<int64_t>(bounds[index], 0, id_bound)),
+									static_cast<int>(std::clamp<int64_t>(bounds[index + 1U], 0, id_bound)),
+									expected_count);
+		for (const auto& term : query.plus_terms) {
+			index_.ForEachPosting(term.term_id, bounds[index], bounds[index + 1U], [&document_to_relevance, &document_predicate, &term, this](const Posting& posting) {
+				if (IsAccepted(document_predicate, posting.document_id)) {
+					document_to_relevance.Add(posting.document_id, posting.term_freq * term.inverse_document_freq);
+				}
+			});
 		}
-		std::vector<Document> matched_documents;
-		for (const auto [document_id, relevance] : document_to_relevance) {
-			matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+
+		for (const TermId term_id : query.minus_terms) {
+			index_.ForEachPosting(term_id, bounds[index], bounds[index + 1U], [&document_to_relevance](const Posting& posting) {
+				document_to_relevance.Exclude(posting.document_id);
+			});
 		}
 
-		return matched_documents;
+		document_to_relevance.ForEach([&top_documents, this](int internal_id, double relevance) {
+			top_documents.Add({external_ids_[internal_id], relevance, attributes_.GetRating(internal_id)});
+		});
 	}
 
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
-		ConcurrentMap<int, double> document_to_relevance(3);
-
-		for_each(std::execution::par,
-				 query.plus_words.begin(), query.plus_words.end(),
-				 [&document_to_relevance, &document_predicate, this](const std::string_view word) {
-					if (word_to_document_freqs_.count(word) == 0U) {
-						return;
-					}
-					const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-					for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-						const auto& document_data = documents_.at(document_id);
-						if (document_predicate(document_id, document_data.status, document_data.rating)) {
-							document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-						}
-					}
-				});
+	void FindAllDocuments(const std::execution::parallel_policy&, const PreparedQuery& query, DocumentPredicate document_predicate, std::vector<Document>& result) const {
+		// Every worker owns one id range and all postings inside it, so no locking is needed
+		const std::vector<int64_t> bounds = SplitDocumentIds(query);
+		std::vector<size_t> range_indexes(bounds.size() - 1U);
+		std::iota(range_indexes.begin(), range_indexes.end(), 0U);
+		std::vector<TopDocuments> partial_tops(range_indexes.size(), TopDocuments(max_result_document_count_));
+		// Ranges hold about the same number of postings
+		const size_t expected_count = GetPostingCount(query) / range_indexes.size();
 
 		for_each(std::execution::par,
-				 query.minus_words.begin(), query.minus_words.end(),
-				 [&document_to_relevance, this](const std::string_view word) {
-					if (word_to_document_freqs_.count(word) == 0U) {
-						return;
-					}
-					for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-						document_to_relevance.erase(document_id);
-					}
+				 range_indexes.begin(), range_indexes.end(),
+				 [&bounds, &partial_tops, &query, &document_predicate, expected_count, this](size_t index) {
+					FindRangeDocuments(query, document_predicate, bounds, index, expected_count, partial_tops[index]);
 				});
 
-		std::vector<Document> matched_documents;
-		for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-			matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+		TopDocuments top_documents(max_result_document_count_);
+		for (const TopDocuments& partial_top : partial_tops) {
+			top_documents.Merge(partial_top);
 		}
-
-		return matched_documents;
+		top_documents.ExtractTo(result);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <execution>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "search_server.h"
+
+// Documents partitioned by a hash of their id over several SearchServer shards. A query is
+// searched on all shards in parallel and their top documents are merged, so even one-word
+// queries are spread over threads. Inverse document frequencies are computed from the
+// document counts of all shards, so relevances equal those of one unsharded server.
+class ShardedSearchServer {
+public:
+	ShardedSearchServer(const std::string& stop_words_text, size_t shard_count);
+
+	void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+	void RemoveDocument(int document_id);
+
+	template <typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
+		std::vector<PreparedQuery> queries = PrepareQueries(raw_query);
+		std::vector<std::vector<Document>> shard_results(shards_.size());
+		std::vector<size_t> shard_indexes(shards_.size());
+		std::iota(shard_indexes.begin(), shard_indexes.end(), 0U);
+
+		// Every shard runs its sequential search, pruning with the global frequencies
+		for_each(std::execution::par,
+				 shard_indexes.begin(), shard_indexes.end(),
+				 [&queries, &shard_results, &document_predicate, this](size_t index) {
+					shard_results[index] = shards_[index].FindTopDocuments(std::execution::seq, queries[index], document_predicate);
+				});
+
+		return MergeResults(shard_results);
+	}
+
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+
+	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+	// Matched words point into the dictionary of the shard holding the document
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+	void SetMaxResultDocumentCount(size_t max_result_document_count);
+
+	int GetDocumentCount() const;
+
+	size_t GetShardCount() const;
+
+private:
+	std::vector<SearchServer> shards_;
+	size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+
+	const SearchServer& GetShard(int document_id) const;
+
+	SearchServer& GetShard(int document_id);
+
+	// Prepares the query on every shard and replaces the shard frequencies by global ones
+	std::vector<PreparedQuery> PrepareQueries(std::string_view raw_query) const;
+
+	std::vector<Document> MergeResults(const std::vector<std::vector<Document>>& shard_results) const;
+};
@@ -6,6 +6,20 @@
 #include <string_view>
 #include <set>
 
+// Words of a text and the result of validating them in the same pass
+struct TokenizedText {
+	std::vector<std::string_view> words;
+	// Index of the first word holding a control character (a byte below ' '), words.size() if none
+	size_t first_invalid_word = 0;
+};
+
+// Splits the text at runs of spaces, so no word is empty. Separators and control characters
+// are found by one vectorized scan; the widest kernel the CPU supports is chosen at runtime.
+TokenizedText Tokenize(std::string_view text);
+
+// Same, reusing the memory of result
+void Tokenize(std::string_view text, TokenizedText& result);
+
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
 template <typename StringContainer>
@@ -18,4 +32,4 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
 	}
 
 	return non_empty_strings;
-}
\ No newline at end of file
+}
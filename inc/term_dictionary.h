@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "text_arena.h"
+
+using TermId = uint32_t;
+
+const TermId NO_TERM = UINT32_MAX;
+
+// Memory taken by the terms a dictionary keeps in memory; mapped base terms are not counted
+struct TermMemoryUsage {
+	size_t term_count = 0;
+	// Bytes of term text
+	size_t text_size = 0;
+	// Bytes held by the dictionary: arena blocks, views, hash slots and free ids
+	size_t used_bytes = 0;
+	// Estimate for the node-based layout this dictionary replaced: one heap std::string per
+	// term in a std::set plus a std::unordered_map<std::string_view, TermId> over it
+	size_t node_layout_bytes = 0;
+};
+
+// Assigns dense ids to distinct terms; ids of erased terms are reused by later insertions.
+// Text is interned into an arena and looked up through an open addressing table of ids.
+// A dictionary may sit on top of a read-only base table, e.g. one in a mapped index file.
+class TermDictionary {
+public:
+	TermDictionary() = default;
+
+	// Views size sorted terms: term i is text[offsets[i]] .. text[offsets[i + 1] - 1] and gets id i.
+	// The arrays are not copied; storage keeps them alive.
+	TermDictionary(std::shared_ptr<const void> storage, const uint64_t* offsets, const char* text, TermId size);
+
+	// Copies keep the ids of the original
+	TermDictionary(const TermDictionary& other);
+
+	TermDictionary(TermDictionary&&) = default;
+
+	TermDictionary& operator=(const TermDictionary& other);
+
+	TermDictionary& operator=(TermDictionary&&) = default;
+
+	TermId Insert(std::string_view term);
+
+	// Frees the id; it must not be used until Insert hands it out again
+	void Erase(TermId term_id);
+
+	TermId Find(std::string_view term) const;
+
+	// The view stays valid until the term is erased
+	std::string_view GetTerm(TermId term_id) const;
+
+	// Whether the id belongs to a live term rather than a free one
+	bool IsLive(TermId term_id) const;
+
+	// Number of live terms
+	size_t GetSize() const;
+
+	// Upper bound of issued ids, live or free
+	size_t GetIdBound() const;
+
+	TermMemoryUsage GetMemoryUsage() const;
+
+private:
+	// Slot of the lookup table; the low hash bits are kept to skip most text comparisons
+	struct Slot {
+		TermId term_id = NO_TERM;
+		uint32_t hash = 0;
+	};
+
+	static constexpr size_t MIN_TABLE_CAPACITY = 16;
+
+	std::shared_ptr<const void> base_storage_;
+	const uint64_t* base_offsets_ = nullptr;
+	const char* base_text_ = nullptr;
+	TermId base_size_ = 0;
+	// Erased base terms keep their ids; allocated on the first erase
+	std::vector<bool> base_erased_;
+	size_t base_erased_count_ = 0;
+	// Terms inserted in memory, term id minus base_size_ indexes terms_. The text lives in
+	// the arena, which reuses the text space of erased terms.
+	TextArena arena_;
+	std::vector<std::string_view> terms_;
+	std::vector<TermId> free_ids_;
+	// Linear probing over ids of in-memory terms, at most 3/4 full; empty slots hold NO_TERM
+	std::vector<Slot> table_;
+	size_t table_size_ = 0;
+
+	static uint64_t CalculateHash(std::string_view term);
+
+	// Returns the index of the slot holding the term or of the empty slot ending its probe sequence
+	size_t FindSlot(std::string_view term, uint64_t hash) const;
+
+	void InsertSlot(TermId term_id, uint64_t hash);
+
+	void EraseSlot(size_t slot);
+
+	void Rehash(size_t capacity);
+
+	// Returns the id of the base term even if it is erased, NO_TERM if there is no such term
+	TermId FindBase(std::string_view term) const;
+
+	bool IsBaseErased(TermId term_id) const;
+
+	// Copies the live in-memory terms into a fresh arena
+	void RebuildArena();
+};
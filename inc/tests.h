@@ -12,14 +12,62 @@ void TestIncludeFindedDocumentsWithPredicate();
 
 void TestSortByRelevance();
 
+void TestMaxResultDocumentCount();
+
+void TestParallelSearchMatchesSequential();
+
 void TestComputeRelevance();
 
 void TestMatchDocuments();
 
+void TestPreparedQuery();
+
+void TestAddDocuments();
+
+void TestSegmentedIndex();
+
+void TestSnapshotIsolation();
+
 void TestRemoveDuplicates();
 
 void TestRemoveDocument();
 
+void TestRemovedDocumentNotFound();
+
+void TestRemoveDocumentReclaimsTerms();
+
+void TestCompactInternalIds();
+
+void TestIndexFile();
+
+void TestTokenizer();
+
+void TestTermInterning();
+
+void TestCorpusIngestion();
+
+void TestCompressedPostings();
+
+void TestBlockMaxWand();
+
+void TestChampionLists();
+
+void TestDocumentAttributes();
+
+void TestInternalDocumentIds();
+
+void TestRelevanceAccumulator();
+
+void TestProcessQueryBatch();
+
+void TestResultCache();
+
+void TestRequestQueue();
+
+void TestSearchExecutor();
+
+void TestShardedSearchServer();
+
 void TestGetWordFrequencies();
 
 void TestGetDocumentCount();
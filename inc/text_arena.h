@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Storage for many small strings. Text is copied into large blocks that never move, so
+// views into the arena stay valid until they are released or the arena is cleared or
+// destroyed, moves included. Space is handed out in size classes: exact lengths for short
+// text, steps of at most a quarter of the length for longer text. Released space is reused
+// by later text of the same class, so churn of texts with a steady length mix does not grow
+// the arena; text larger than a block gets a block of its own, which release frees.
+class TextArena {
+public:
+	static constexpr size_t DEFAULT_BLOCK_SIZE = 64U * 1024U;
+
+	explicit TextArena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+	TextArena(TextArena&&) = default;
+
+	TextArena& operator=(TextArena&&) = default;
+
+	// Copies the text into the arena
+	std::string_view Store(std::string_view text);
+
+	// Gives the space of a stored text back for reuse
+	void Release(std::string_view text);
+
+	void Clear();
+
+	// Bytes of stored text not yet released
+	size_t GetUsedSize() const;
+
+	// Bytes held by blocks
+	size_t GetCapacity() const;
+
+private:
+	struct Block {
+		std::unique_ptr<char[]> data;
+		size_t size = 0;
+		size_t capacity = 0;
+	};
+
+	// Text up to this length takes exactly its length
+	static constexpr size_t MAX_EXACT_SIZE = 64;
+
+	size_t block_size_;
+	// The last block receives new text
+	std::vector<Block> blocks_;
+	// Blocks of single texts larger than a block, freed when the text is released
+	std::vector<Block> own_blocks_;
+	// free_texts_[c] holds released spaces of size class c
+	std::vector<std::vector<char*>> free_texts_;
+	size_t used_size_ = 0;
+	size_t capacity_ = 0;
+
+	// Bytes taken by a text of the given size
+	static size_t GetSpaceSize(size_t size);
+
+	static size_t GetSizeClass(size_t size);
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "document.h"
+
+const double RELEVANCE_EPSILON = 1e-6;
+
+// Ranking order of search results: by relevance, then by rating, then by id
+// so that the selection does not depend on the order candidates arrive in
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+	if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+		if (lhs.rating == rhs.rating) {
+			return lhs.id < rhs.id;
+		}
+		return lhs.rating > rhs.rating;
+	} else {
+		return lhs.relevance > rhs.relevance;
+	}
+}
+
+// Bounded selection of the best documents: never holds more than limit candidates
+class TopDocuments {
+public:
+	explicit TopDocuments(size_t limit)
+		: limit_(limit) {
+		heap_.reserve(limit_);
+	}
+
+	void Add(const Document& document) {
+		if (heap_.size() < limit_) {
+			heap_.push_back(document);
+			std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+		} else if (limit_ > 0U && IsMoreRelevant(document, heap_.front())) {
+			std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+			heap_.back() = document;
+			std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+		}
+	}
+
+	void Merge(const TopDocuments& other) {
+		for (const Document& document : other.heap_) {
+			Add(document);
+		}
+	}
+
+	// Empties the selection but keeps its memory
+	void Reset(size_t limit) {
+		limit_ = limit;
+		heap_.clear();
+		heap_.reserve(limit_);
+	}
+
+	size_t GetLimit() const {
+		return limit_;
+	}
+
+	size_t size() const {
+		return heap_.size();
+	}
+
+	// Documents less relevant than this can not enter the selection. The threshold leaves
+	// room for rounding errors of estimated relevance bounds.
+	double GetThreshold() const {
+		if (heap_.size() < limit_) {
+			return -std::numeric_limits<double>::infinity();
+		}
+		if (limit_ == 0U) {
+			return std::numeric_limits<double>::infinity();
+		}
+
+		return heap_.front().relevance - 2.0 * RELEVANCE_EPSILON;
+	}
+
+	// Returns the selected documents from the most to the least relevant
+	std::vector<Document> Extract() {
+		std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+
+		return std::move(heap_);
+	}
+
+	// Same, copying into a caller-provided buffer so neither side gives up its memory
+	void ExtractTo(std::vector<Document>& result) {
+		std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+		result.assign(heap_.begin(), heap_.end());
+		heap_.clear();
+	}
+
+private:
+	size_t limit_;
+	// The least relevant selected document is on top
+	std::vector<Document> heap_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cache_line.h"
+
+// Fixed set of worker threads, each with its own task deque. A worker runs its newest
+// task first and, when it runs dry, takes the oldest tasks of the shared queue and of the
+// other workers. Tasks submitted from a worker go to its own deque, so a task splitting
+// itself keeps its pieces local unless idle workers steal them.
+class WorkStealingPool {
+public:
+	using Task = std::function<void()>;
+
+	explicit WorkStealingPool(size_t thread_count);
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// Runs the tasks still queued, then joins the workers
+	~WorkStealingPool();
+
+	// Tasks must not throw
+	void Submit(Task task);
+
+	size_t GetThreadCount() const;
+
+private:
+	struct alignas(CACHE_LINE_SIZE) TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// One deque per worker followed by the shared queue of tasks from other threads
+	std::unique_ptr<TaskQueue[]> queues_;
+	size_t thread_count_;
+	// Tasks in all queues; workers sleep while it is zero
+	std::atomic<size_t> queued_count_ = 0;
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_up_;
+	bool is_stopping_ = false;
+	std::vector<std::thread> threads_;
+
+	void RunWorker(size_t worker_index);
+
+	bool TryPop(size_t worker_index, Task& task);
+};
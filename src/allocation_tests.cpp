@@ -0,0 +1,161 @@
+// Separate executable: replacing the global allocation functions to count heap allocations
+// must not change the allocator of the search engine itself
+#include "../inc/search_server.h"
+#include "../inc/assert.h"
+
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// GCC pairs inlined calls of the replaced operators with malloc and free and warns
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+
+// Heap allocations made by the current thread
+thread_local size_t allocation_count = 0;
+
+void* CountedAllocate(size_t size) {
+	++allocation_count;
+	if (void* const memory = malloc(size == 0U ? 1U : size)) {
+		return memory;
+	}
+	throw bad_alloc();
+}
+
+void* CountedAllocate(size_t size, align_val_t alignment) {
+	++allocation_count;
+	const size_t alignment_size = static_cast<size_t>(alignment);
+	// aligned_alloc wants a multiple of the alignment
+	const size_t aligned_size = (max<size_t>(size, 1U) + alignment_size - 1U) / alignment_size * alignment_size;
+	if (void* const memory = aligned_alloc(alignment_size, aligned_size)) {
+		return memory;
+	}
+	throw bad_alloc();
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+	return CountedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+	return CountedAllocate(size);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+	return CountedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+	return CountedAllocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, align_val_t) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t, align_val_t) noexcept {
+	free(memory);
+}
+
+namespace {
+
+SearchServer GenerateSearchServer(int document_count) {
+	static const vector<string> dictionary = {
+		"cat"s, "dog"s, "bird"s, "fish"s, "white"s, "black"s, "curly"s, "nasty"s, "big"s, "small"s,
+		"tail"s, "eyes"s, "hat"s, "collar"s, "john"s, "pigeon"s, "rat"s, "pet"s, "funny"s, "hair"s,
+	};
+	mt19937 generator(42);
+	uniform_int_distribution<int> word_count(1, 12);
+	uniform_int_distribution<size_t> word_index(0U, dictionary.size() - 1U);
+	uniform_int_distribution<int> rating(-10, 10);
+	SearchServer search_server("with and"s);
+	for (int id = 0; id < document_count; ++id) {
+		string text;
+		for (int i = word_count(generator); i > 0; --i) {
+			text += dictionary[word_index(generator)];
+			text += ' ';
+		}
+		search_server.AddDocument(id * 7, text, static_cast<DocumentStatus>(id % 4), {rating(generator), rating(generator)});
+	}
+
+	return search_server;
+}
+
+const vector<string> QUERIES = {
+	"cat"s, "curly cat -dog"s, "nasty big rat -john -hair"s, "white black fish bird tail eyes hat"s,
+	"pet funny -cat -dog"s, "unknown words only"s, "-cat"s,
+};
+
+void TestAllocationFreeQueries() {
+	SearchServer search_server = GenerateSearchServer(2000);
+	search_server.FlushIndex();
+	search_server.RemoveDocument(7);
+	search_server.AddDocument(100000, "curly cat with funny hat"s, DocumentStatus::ACTUAL, {5});
+	const auto even_rating = [](int document_id, DocumentStatus status, int rating) {
+		return rating % 2 == 0;
+	};
+	const PreparedQuery prepared_query = search_server.PrepareQuery("curly cat -dog"s);
+	vector<Document> result;
+	const auto run_queries = [&]() {
+		for (const string& query : QUERIES) {
+			search_server.FindTopDocuments(query, result);
+			search_server.FindTopDocuments(query, DocumentStatus::BANNED, result);
+			search_server.FindTopDocuments(query, even_rating, result);
+		}
+		search_server.FindTopDocuments(prepared_query, result);
+	};
+
+	for (const string& query : QUERIES) {
+		search_server.FindTopDocuments(query, even_rating, result);
+		const vector<Document> expected = search_server.FindTopDocuments(query, even_rating);
+		ASSERT_EQUAL(result.size(), expected.size());
+		for (size_t i = 0; i < result.size(); ++i) {
+			ASSERT_EQUAL(result[i].id, expected[i].id);
+		}
+	}
+	run_queries();
+	const size_t allocations_before = allocation_count;
+	run_queries();
+	// Read the counter before the assertion builds its message strings
+	const size_t query_allocations = allocation_count - allocations_before;
+	ASSERT_EQUAL_HINT(query_allocations, 0U, "Steady-state queries must not allocate"s);
+}
+
+} // namespace
+
+int main() {
+	RUN_TEST(TestAllocationFreeQueries);
+}
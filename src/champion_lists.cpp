@@ -0,0 +1,121 @@
+#include "../inc/champion_lists.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+bool HasHigherTermFreq(const Posting& lhs, const Posting& rhs) {
+	return lhs.term_freq > rhs.term_freq;
+}
+
+} // namespace
+
+ChampionLists::ChampionLists(size_t champion_count)
+	: champion_count_(champion_count) {
+}
+
+bool ChampionLists::IsEnabled() const {
+	return champion_count_ > 0U;
+}
+
+size_t ChampionLists::GetChampionCount() const {
+	return champion_count_;
+}
+
+void ChampionLists::Rebuild(const InvertedIndex& index, TermId term_id) {
+	if (!UpdateDocumentFreq(index, term_id)) {
+		champions_.erase(term_id);
+		return;
+	}
+
+	Champions& champions = champions_[term_id];
+	PostingList& postings = champions.postings;
+	postings.clear();
+	index.ForEachPosting(term_id, [&postings](const Posting& posting) {
+		postings.push_back(posting);
+	});
+	champions.rest_max_term_freq = 0.0;
+	if (postings.size() > champion_count_) {
+		nth_element(postings.begin(), postings.begin() + champion_count_, postings.end(), HasHigherTermFreq);
+		for (auto it = postings.begin() + champion_count_; it != postings.end(); ++it) {
+			champions.rest_max_term_freq = max(champions.rest_max_term_freq, it->term_freq);
+		}
+		postings.resize(champion_count_);
+	}
+	postings.shrink_to_fit();
+	sort(postings.begin(), postings.end(), HasHigherTermFreq);
+}
+
+void ChampionLists::AddPosting(const InvertedIndex& index, TermId term_id, const Posting& posting) {
+	if (!UpdateDocumentFreq(index, term_id)) {
+		return;
+	}
+	const auto it = champions_.find(term_id);
+	if (it == champions_.end()) {
+		Rebuild(index, term_id);
+		return;
+	}
+
+	PostingList& postings = it->second.postings;
+	// A rebuild earlier in the same batch has seen the posting already
+	const bool is_known = any_of(postings.begin(), postings.end(), [&posting](const Posting& champion) {
+		return champion.document_id == posting.document_id;
+	});
+	if (is_known) {
+		return;
+	}
+	if (postings.size() == champion_count_) {
+		if (!HasHigherTermFreq(posting, postings.back())) {
+			it->second.rest_max_term_freq = max(it->second.rest_max_term_freq, posting.term_freq);
+			return;
+		}
+		it->second.rest_max_term_freq = max(it->second.rest_max_term_freq, postings.back().term_freq);
+		postings.pop_back();
+	}
+	postings.insert(upper_bound(postings.begin(), postings.end(), posting, HasHigherTermFreq), posting);
+}
+
+void ChampionLists::RemovePosting(const InvertedIndex& index, TermId term_id, int document_id) {
+	if (!UpdateDocumentFreq(index, term_id)) {
+		champions_.erase(term_id);
+		return;
+	}
+	const auto it = champions_.find(term_id);
+	if (it == champions_.end()) {
+		Rebuild(index, term_id);
+		return;
+	}
+
+	PostingList& postings = it->second.postings;
+	postings.erase(remove_if(postings.begin(), postings.end(), [document_id](const Posting& posting) {
+		return posting.document_id == document_id;
+	}), postings.end());
+	// Removals wear the list down; refill it before most of the bound is guesswork
+	if (postings.size() < champion_count_ / 2U) {
+		Rebuild(index, term_id);
+	}
+}
+
+void ChampionLists::SetDocumentCount(size_t document_count) {
+	log_document_count_ = log(static_cast<double>(document_count));
+}
+
+double ChampionLists::GetInverseDocumentFreq(TermId term_id) const {
+	return log_document_count_ - log_document_freqs_[term_id];
+}
+
+bool ChampionLists::UpdateDocumentFreq(const InvertedIndex& index, TermId term_id) {
+	if (!IsEnabled()) {
+		return false;
+	}
+	if (term_id >= log_document_freqs_.size()) {
+		log_document_freqs_.resize(term_id + 1U);
+	}
+	const size_t document_freq = index.GetDocumentFreq(term_id);
+	log_document_freqs_[term_id] = log(static_cast<double>(document_freq));
+
+	return document_freq > champion_count_;
+}
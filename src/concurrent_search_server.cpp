@@ -0,0 +1,85 @@
+#include "../inc/concurrent_search_server.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ConcurrentSearchServer::ConcurrentSearchServer(SearchServer search_server, size_t publish_interval, Clock::duration max_staleness)
+	: master_(move(search_server))
+	, publish_interval_(publish_interval)
+	, max_staleness_(max(max_staleness, Clock::duration::zero())) {
+	PublishMaster();
+	publisher_ = thread([this]() {
+		RunPublisher();
+	});
+}
+
+ConcurrentSearchServer::~ConcurrentSearchServer() {
+	{
+		lock_guard guard(writer_mutex_);
+		is_stopping_ = true;
+	}
+	publisher_wake_up_.notify_one();
+	publisher_.join();
+}
+
+shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+	return atomic_load(&snapshot_);
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+	lock_guard guard(writer_mutex_);
+	master_.AddDocument(document_id, document, status, ratings);
+	CountWrites(1U);
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+	lock_guard guard(writer_mutex_);
+	master_.RemoveDocument(document_id);
+	CountWrites(1U);
+}
+
+void ConcurrentSearchServer::Publish() {
+	lock_guard guard(writer_mutex_);
+	PublishMaster();
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+	return GetSnapshot()->GetDocumentCount();
+}
+
+void ConcurrentSearchServer::CountWrites(size_t document_count) {
+	if (document_count == 0U) {
+		return;
+	}
+	if (unpublished_writes_ == 0U) {
+		first_unpublished_write_ = Clock::now();
+		publisher_wake_up_.notify_one();
+	}
+	unpublished_writes_ += document_count;
+	const size_t publish_interval = publish_interval_ != ADAPTIVE_PUBLISH_INTERVAL
+		? publish_interval_
+		: max(static_cast<size_t>(master_.GetDocumentCount()) / ADAPTIVE_PUBLISH_RATIO, size_t{1});
+	if (unpublished_writes_ >= publish_interval) {
+		PublishMaster();
+	}
+}
+
+void ConcurrentSearchServer::PublishMaster() {
+	shared_ptr<const SearchServer> snapshot = make_shared<const SearchServer>(master_);
+	atomic_store(&snapshot_, move(snapshot));
+	unpublished_writes_ = 0;
+}
+
+void ConcurrentSearchServer::RunPublisher() {
+	unique_lock lock(writer_mutex_);
+	while (!is_stopping_) {
+		if (unpublished_writes_ == 0U || max_staleness_ == Clock::duration::max()) {
+			publisher_wake_up_.wait(lock);
+		} else if (Clock::now() - first_unpublished_write_ >= max_staleness_) {
+			PublishMaster();
+		} else {
+			publisher_wake_up_.wait_until(lock, first_unpublished_write_ + max_staleness_);
+		}
+	}
+}
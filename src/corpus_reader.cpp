@@ -0,0 +1,89 @@
+#include "../inc/corpus_reader.h"
+
+#include <charconv>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const string_view DOCUMENT_STATUS_NAMES[] = {"ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv};
+
+// Cuts the text up to the separator off the front of the line
+string_view TakeField(string_view& line, char separator) {
+	const size_t end = line.find(separator);
+	const string_view field = line.substr(0, end);
+	line.remove_prefix(end == line.npos ? line.size() : end + 1U);
+
+	return field;
+}
+
+bool ParseInt(string_view text, int& value) {
+	const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+
+	return error == errc() && end == text.data() + text.size();
+}
+
+} // namespace
+
+CorpusReader::CorpusReader(const string& path)
+	: file_(make_shared<const MappedFile>(path))
+	, rest_(file_->GetData(), file_->GetSize()) {
+}
+
+bool CorpusReader::ReadBatch(vector<RawDocument>& batch, size_t max_count) {
+	size_t count = 0;
+	while (count < max_count && !rest_.empty()) {
+		string_view line = TakeField(rest_, '\n');
+		++line_number_;
+		if (!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
+		if (line.empty()) {
+			continue;
+		}
+		if (count == batch.size()) {
+			batch.emplace_back();
+		}
+		ParseRecord(line, batch[count]);
+		++count;
+	}
+	batch.resize(count);
+
+	return count > 0U;
+}
+
+void CorpusReader::ParseRecord(string_view line, RawDocument& document) const {
+	const auto fail = [this]() {
+		throw invalid_argument("Corpus record "s + to_string(line_number_) + " is malformed"s);
+	};
+
+	if (!ParseInt(TakeField(line, '\t'), document.id)) {
+		fail();
+	}
+
+	const string_view status = TakeField(line, '\t');
+	const auto status_name = find(begin(DOCUMENT_STATUS_NAMES), end(DOCUMENT_STATUS_NAMES), status);
+	if (status_name == end(DOCUMENT_STATUS_NAMES)) {
+		fail();
+	}
+	document.status = static_cast<DocumentStatus>(status_name - begin(DOCUMENT_STATUS_NAMES));
+
+	string_view ratings = TakeField(line, '\t');
+	document.ratings.clear();
+	while (!ratings.empty()) {
+		const string_view rating = TakeField(ratings, ' ');
+		if (rating.empty()) {
+			continue;
+		}
+		if (!ParseInt(rating, document.ratings.emplace_back())) {
+			fail();
+		}
+	}
+
+	document.text = line;
+}
+
+void AddDocumentsFromFile(SearchServer& search_server, const string& path, size_t batch_size) {
+	AddDocumentsFromFile(execution::seq, search_server, path, batch_size);
+}
@@ -0,0 +1,37 @@
+#include "../inc/document_attributes.h"
+
+using namespace std;
+
+void DocumentAttributes::Add(int internal_id, int rating, DocumentStatus status) {
+	const size_t index = static_cast<size_t>(internal_id);
+	if (index >= ratings_.size()) {
+		ratings_.resize(index + 1U);
+		for (vector<uint64_t>& bits : status_bits_) {
+			bits.resize(index / 64U + 1U);
+		}
+	}
+	ratings_[index] = rating;
+	status_bits_[static_cast<size_t>(status)][index / 64U] |= uint64_t{1} << (index % 64U);
+	++size_;
+}
+
+void DocumentAttributes::Remove(int internal_id) {
+	const size_t index = static_cast<size_t>(internal_id);
+	for (vector<uint64_t>& bits : status_bits_) {
+		bits[index / 64U] &= ~(uint64_t{1} << (index % 64U));
+	}
+	--size_;
+}
+
+size_t DocumentAttributes::GetSize() const {
+	return size_;
+}
+
+DocumentStatus DocumentAttributes::GetStatus(int internal_id) const {
+	size_t status = 0;
+	while (status + 1U < DOCUMENT_STATUS_COUNT && !HasStatus(internal_id, static_cast<DocumentStatus>(status))) {
+		++status;
+	}
+
+	return static_cast<DocumentStatus>(status);
+}
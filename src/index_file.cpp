@@ -0,0 +1,189 @@
+#include "../inc/index_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define INDEX_FILE_USE_MMAP
+#endif
+
+using namespace std;
+
+namespace {
+
+const uint64_t SECTION_ALIGNMENT = 8;
+
+} // namespace
+
+MappedFile::MappedFile(const string& path) {
+#ifdef INDEX_FILE_USE_MMAP
+	const int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		throw runtime_error("Cannot open index file "s + path);
+	}
+	struct stat file_stat;
+	if (fstat(descriptor, &file_stat) != 0) {
+		close(descriptor);
+		throw runtime_error("Cannot open index file "s + path);
+	}
+	size_ = static_cast<size_t>(file_stat.st_size);
+	if (size_ > 0U) {
+		void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (data == MAP_FAILED) {
+			close(descriptor);
+			throw runtime_error("Cannot map index file "s + path);
+		}
+		data_ = static_cast<const char*>(data);
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(descriptor);
+#else
+	ifstream in(path, ios::binary);
+	if (!in) {
+		throw runtime_error("Cannot open index file "s + path);
+	}
+	buffer_.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	data_ = buffer_.data();
+	size_ = buffer_.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef INDEX_FILE_USE_MMAP
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+#endif
+}
+
+const char* MappedFile::GetData() const {
+	return data_;
+}
+
+size_t MappedFile::GetSize() const {
+	return size_;
+}
+
+void ThrowCorruptedIndexFile() {
+	throw invalid_argument("Index file is corrupted"s);
+}
+
+IndexFileHeader ReadIndexFileHeader(const MappedFile& file) {
+	if (file.GetSize() < sizeof(IndexFileHeader)) {
+		ThrowCorruptedIndexFile();
+	}
+	IndexFileHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) != 0 || header.byte_order != INDEX_FILE_BYTE_ORDER) {
+		ThrowCorruptedIndexFile();
+	}
+	if (header.version != INDEX_FILE_VERSION) {
+		throw invalid_argument("Unsupported index file version "s + to_string(header.version));
+	}
+
+	return header;
+}
+
+const uint64_t* GetOffsetsData(const MappedFile& file, FileSection section, uint64_t end_value) {
+	const uint64_t* offsets = GetSectionData<uint64_t>(file, section);
+	if (section.count == 0U || offsets[0] != 0U || offsets[section.count - 1U] != end_value
+		|| !is_sorted(offsets, offsets + section.count)) {
+		ThrowCorruptedIndexFile();
+	}
+
+	return offsets;
+}
+
+IndexFileWriter::IndexFileWriter(const string& path)
+	: path_(path)
+	, temporary_path_(path + ".tmp"s)
+	, out_(temporary_path_, ios::binary | ios::trunc) {
+	if (!out_) {
+		throw runtime_error("Cannot create index file "s + temporary_path_);
+	}
+	// Room for the header, which is written by Finish
+	const IndexFileHeader header;
+	WriteBytes(&header, 1U, sizeof(header));
+}
+
+IndexFileWriter::~IndexFileWriter() {
+	if (!is_finished_) {
+		out_.close();
+		error_code error;
+		filesystem::remove(temporary_path_, error);
+	}
+}
+
+pair<FileSection, FileSection> IndexFileWriter::WriteStrings(const vector<string_view>& strings) {
+	vector<uint64_t> offsets = {0U};
+	offsets.reserve(strings.size() + 1U);
+	string text;
+	for (const string_view value : strings) {
+		text += value;
+		offsets.push_back(text.size());
+	}
+	const FileSection offsets_section = Write(offsets);
+
+	return {offsets_section, WriteBytes(text.data(), text.size(), 1U)};
+}
+
+void IndexFileWriter::Finish(IndexFileHeader header) {
+	memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+	header.version = INDEX_FILE_VERSION;
+	header.byte_order = INDEX_FILE_BYTE_ORDER;
+	out_.seekp(0);
+	out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out_.close();
+	if (!out_) {
+		throw runtime_error("Cannot write index file"s);
+	}
+#ifdef INDEX_FILE_USE_MMAP
+	// The data must be on disk before the rename makes it the index
+	const int descriptor = open(temporary_path_.c_str(), O_RDONLY);
+	if (descriptor < 0 || fsync(descriptor) != 0) {
+		if (descriptor >= 0) {
+			close(descriptor);
+		}
+		throw runtime_error("Cannot flush index file "s + temporary_path_);
+	}
+	close(descriptor);
+#endif
+	error_code error;
+	filesystem::rename(temporary_path_, path_, error);
+	if (error) {
+		throw runtime_error("Cannot replace index file "s + path_ + ": "s + error.message());
+	}
+	is_finished_ = true;
+#ifdef INDEX_FILE_USE_MMAP
+	// Makes the rename itself durable; failing to is not an error of the write
+	const filesystem::path directory = filesystem::path(path_).parent_path();
+	const int directory_descriptor = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+	if (directory_descriptor >= 0) {
+		fsync(directory_descriptor);
+		close(directory_descriptor);
+	}
+#endif
+}
+
+FileSection IndexFileWriter::WriteBytes(const void* data, size_t count, size_t element_size) {
+	static const char padding[SECTION_ALIGNMENT] = {};
+	const uint64_t padding_size = (SECTION_ALIGNMENT - position_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT;
+	out_.write(padding, padding_size);
+	position_ += padding_size;
+
+	const FileSection section{position_, count};
+	out_.write(static_cast<const char*>(data), count * element_size);
+	position_ += count * element_size;
+	if (!out_) {
+		throw runtime_error("Cannot write index file"s);
+	}
+
+	return section;
+}
@@ -0,0 +1,330 @@
+#include "../inc/index_segment.h"
+
+#include <algorithm>
+
+using namespace std;
+
+PostingRange MakePostingRange(const PostingList& postings) {
+	return {postings.data(), postings.data() + postings.size()};
+}
+
+const Posting* FindPosting(PostingRange postings, int document_id) {
+	const Posting* it = lower_bound(postings.begin(), postings.end(), document_id, [](const Posting& posting, int id) {
+		return posting.document_id < id;
+	});
+
+	return (it != postings.end() && it->document_id == document_id) ? it : postings.end();
+}
+
+PostingRange SlicePostings(PostingRange postings, int64_t first_document_id, int64_t last_document_id) {
+	const auto less_id = [](const Posting& posting, int64_t id) {
+		return posting.document_id < id;
+	};
+	const Posting* first = lower_bound(postings.begin(), postings.end(), first_document_id, less_id);
+	const Posting* last = lower_bound(first, postings.end(), last_document_id, less_id);
+
+	return {first, last};
+}
+
+namespace {
+
+unsigned GetBitWidth(uint64_t value) {
+	unsigned width = 0;
+	for (; value != 0U; value >>= 1U) {
+		++width;
+	}
+
+	return width;
+}
+
+// Values are packed from the lowest bit of the first word upwards and may straddle two words
+void AppendBits(vector<uint64_t>& words, size_t first_word, size_t& bit_position, uint64_t value, unsigned width) {
+	if (width == 0U) {
+		return;
+	}
+	const size_t word = first_word + bit_position / 64U;
+	const unsigned shift = bit_position % 64U;
+	if (word == words.size()) {
+		words.push_back(0U);
+	}
+	words[word] |= value << shift;
+	if (shift + width > 64U) {
+		words.push_back(value >> (64U - shift));
+	}
+	bit_position += width;
+}
+
+uint64_t ReadBits(const uint64_t* words, size_t bit_position, unsigned width) {
+	if (width == 0U) {
+		return 0U;
+	}
+	const size_t word = bit_position / 64U;
+	const unsigned shift = bit_position % 64U;
+	uint64_t value = words[word] >> shift;
+	if (shift + width > 64U) {
+		value |= words[word + 1U] << (64U - shift);
+	}
+
+	return value & ((uint64_t{1} << width) - 1U);
+}
+
+size_t GetPackedWordCount(const PostingBlock& block) {
+	const size_t bit_count = (block.posting_count - 1U) * size_t{block.gap_bits} + block.posting_count * size_t{block.term_freq_bits};
+
+	return (bit_count + 63U) / 64U;
+}
+
+} // namespace
+
+class ImmutableSegment::Encoder {
+public:
+	Encoder() {
+		arrays_.posting_offsets.push_back(0U);
+		arrays_.block_offsets.push_back(0U);
+	}
+
+	// Appends the row of the next term id, sorted by document id
+	void AddRow(PostingRange row) {
+		for (const Posting* block_begin = row.begin(); block_begin != row.end();) {
+			const Posting* const block_end = block_begin + min<size_t>(POSTING_BLOCK_SIZE, row.end() - block_begin);
+			AddBlock(block_begin, block_end);
+			block_begin = block_end;
+		}
+		arrays_.posting_offsets.push_back(arrays_.posting_offsets.back() + row.size());
+		arrays_.block_offsets.push_back(arrays_.blocks.size());
+	}
+
+	void Finish(shared_ptr<const void>& storage, Layout& layout) {
+		vector<int>& document_ids = arrays_.document_ids;
+		sort(document_ids.begin(), document_ids.end());
+		document_ids.erase(unique(document_ids.begin(), document_ids.end()), document_ids.end());
+		document_ids.shrink_to_fit();
+		arrays_.packed_data.shrink_to_fit();
+		arrays_.term_freqs.shrink_to_fit();
+
+		const auto arrays = make_shared<const Arrays>(move(arrays_));
+		storage = arrays;
+		layout.posting_offsets = MakeRange(arrays->posting_offsets);
+		layout.block_offsets = MakeRange(arrays->block_offsets);
+		layout.blocks = MakeRange(arrays->blocks);
+		layout.packed_data = MakeRange(arrays->packed_data);
+		layout.term_freqs = MakeRange(arrays->term_freqs);
+		layout.document_ids = MakeRange(arrays->document_ids);
+	}
+
+private:
+	struct Arrays {
+		vector<uint64_t> posting_offsets;
+		vector<uint64_t> block_offsets;
+		vector<PostingBlock> blocks;
+		vector<uint64_t> packed_data;
+		vector<double> term_freqs;
+		vector<int> document_ids;
+	};
+
+	Arrays arrays_;
+	// Distinct term frequencies of the current block
+	vector<double> block_term_freqs_;
+
+	template <typename T>
+	static IteratorRange<const T*> MakeRange(const vector<T>& values) {
+		return {values.data(), values.data() + values.size()};
+	}
+
+	void AddBlock(const Posting* first, const Posting* last) {
+		const size_t posting_count = last - first;
+		uint32_t max_gap = 0;
+		block_term_freqs_.clear();
+		for (const Posting* posting = first; posting != last; ++posting) {
+			if (posting != first) {
+				max_gap = max(max_gap, static_cast<uint32_t>(posting->document_id - posting[-1].document_id - 1));
+			}
+			block_term_freqs_.push_back(posting->term_freq);
+			arrays_.document_ids.push_back(posting->document_id);
+		}
+		sort(block_term_freqs_.begin(), block_term_freqs_.end());
+		block_term_freqs_.erase(unique(block_term_freqs_.begin(), block_term_freqs_.end()), block_term_freqs_.end());
+
+		PostingBlock block{};
+		block.first_document_id = first->document_id;
+		block.last_document_id = last[-1].document_id;
+		block.data_offset = arrays_.packed_data.size();
+		block.term_freq_offset = arrays_.term_freqs.size();
+		block.posting_count = static_cast<uint16_t>(posting_count);
+		block.term_freq_count = static_cast<uint16_t>(block_term_freqs_.size());
+		block.gap_bits = static_cast<uint8_t>(GetBitWidth(max_gap));
+		block.term_freq_bits = static_cast<uint8_t>(GetBitWidth(block_term_freqs_.size() - 1U));
+		arrays_.term_freqs.insert(arrays_.term_freqs.end(), block_term_freqs_.begin(), block_term_freqs_.end());
+
+		size_t bit_position = 0;
+		for (const Posting* posting = first + 1; posting < last; ++posting) {
+			AppendBits(arrays_.packed_data, block.data_offset, bit_position, posting->document_id - posting[-1].document_id - 1, block.gap_bits);
+		}
+		for (const Posting* posting = first; posting != last; ++posting) {
+			const size_t index = lower_bound(block_term_freqs_.begin(), block_term_freqs_.end(), posting->term_freq) - block_term_freqs_.begin();
+			AppendBits(arrays_.packed_data, block.data_offset, bit_position, index, block.term_freq_bits);
+		}
+		arrays_.blocks.push_back(block);
+	}
+};
+
+ImmutableSegment::ImmutableSegment(const vector<PostingList>& rows) {
+	Encoder encoder;
+	for (const PostingList& row : rows) {
+		encoder.AddRow(MakePostingRange(row));
+	}
+	encoder.Finish(storage_, layout_);
+}
+
+ImmutableSegment::ImmutableSegment(const vector<MergeInput>& inputs) {
+	size_t term_bound = 0;
+	for (const MergeInput& input : inputs) {
+		term_bound = max(term_bound, input.segment->GetTermBound());
+	}
+
+	Encoder encoder;
+	PostingList row;
+	for (TermId term_id = 0; term_id < term_bound; ++term_id) {
+		row.clear();
+		for (const MergeInput& input : inputs) {
+			input.segment->ForEachPosting(term_id, INT64_MIN, INT64_MAX, [&row, &input](const Posting& posting) {
+				if (input.deleted.count(posting.document_id) == 0U) {
+					row.push_back(posting);
+				}
+			});
+		}
+		// Live documents of different segments are disjoint, so only the order has to be restored
+		sort(row.begin(), row.end(), [](const Posting& lhs, const Posting& rhs) {
+			return lhs.document_id < rhs.document_id;
+		});
+		encoder.AddRow(MakePostingRange(row));
+	}
+	encoder.Finish(storage_, layout_);
+}
+
+ImmutableSegment::ImmutableSegment(shared_ptr<const void> storage, const Layout& layout)
+	: storage_(move(storage))
+	, layout_(layout) {
+}
+
+bool ImmutableSegment::HasPosting(TermId term_id, int document_id) const {
+	if (term_id >= GetTermBound()) {
+		return false;
+	}
+	const PostingBlock* const block = FindBlock(term_id, document_id);
+	if (block == layout_.blocks.begin() + layout_.block_offsets.begin()[term_id + 1U] || block->first_document_id > document_id) {
+		return false;
+	}
+	int document_ids[POSTING_BLOCK_SIZE];
+	DecodeDocumentIds(*block, document_ids);
+
+	return binary_search(document_ids, document_ids + block->posting_count, document_id);
+}
+
+bool ImmutableSegment::HasDocument(int document_id) const {
+	return binary_search(layout_.document_ids.begin(), layout_.document_ids.end(), document_id);
+}
+
+size_t ImmutableSegment::GetPostingCount(TermId term_id) const {
+	if (term_id >= GetTermBound()) {
+		return 0U;
+	}
+	const uint64_t* const offsets = layout_.posting_offsets.begin();
+
+	return offsets[term_id + 1U] - offsets[term_id];
+}
+
+size_t ImmutableSegment::GetPostingCount() const {
+	return layout_.posting_offsets.size() == 0U ? 0U : layout_.posting_offsets.end()[-1];
+}
+
+size_t ImmutableSegment::GetDocumentCount() const {
+	return layout_.document_ids.size();
+}
+
+size_t ImmutableSegment::GetTermBound() const {
+	return layout_.posting_offsets.size() == 0U ? 0U : layout_.posting_offsets.size() - 1U;
+}
+
+const ImmutableSegment::Layout& ImmutableSegment::GetLayout() const {
+	return layout_;
+}
+
+IteratorRange<const PostingBlock*> ImmutableSegment::GetBlocks(TermId term_id) const {
+	if (term_id >= GetTermBound()) {
+		return {};
+	}
+	const PostingBlock* const blocks = layout_.blocks.begin();
+
+	return {blocks + layout_.block_offsets.begin()[term_id], blocks + layout_.block_offsets.begin()[term_id + 1U]};
+}
+
+double ImmutableSegment::GetMaxTermFreq(const PostingBlock& block) const {
+	// Distinct frequencies of a block are sorted ascending
+	return layout_.term_freqs.begin()[block.term_freq_offset + block.term_freq_count - 1U];
+}
+
+bool ImmutableSegment::IsConsistent() const {
+	const auto& posting_offsets = layout_.posting_offsets;
+	const auto& block_offsets = layout_.block_offsets;
+	if (posting_offsets.size() == 0U || posting_offsets.size() != block_offsets.size()
+		|| block_offsets.begin()[0] != 0U || block_offsets.end()[-1] != layout_.blocks.size()
+		|| !is_sorted(block_offsets.begin(), block_offsets.end()) || posting_offsets.begin()[0] != 0U) {
+		return false;
+	}
+
+	for (size_t term_id = 0; term_id + 1U < posting_offsets.size(); ++term_id) {
+		uint64_t posting_count = 0;
+		int64_t previous_last = INT64_MIN;
+		for (uint64_t index = block_offsets.begin()[term_id]; index < block_offsets.begin()[term_id + 1U]; ++index) {
+			const PostingBlock& block = layout_.blocks.begin()[index];
+			const bool is_valid = block.posting_count > 0U && block.posting_count <= POSTING_BLOCK_SIZE
+				&& block.first_document_id > previous_last && block.first_document_id <= block.last_document_id
+				&& block.gap_bits <= 32U && block.term_freq_bits <= 16U && block.term_freq_count > 0U
+				&& block.term_freq_offset <= layout_.term_freqs.size()
+				&& block.term_freq_count <= layout_.term_freqs.size() - block.term_freq_offset
+				&& block.data_offset <= layout_.packed_data.size()
+				&& GetPackedWordCount(block) <= layout_.packed_data.size() - block.data_offset;
+			if (!is_valid) {
+				return false;
+			}
+			posting_count += block.posting_count;
+			previous_last = block.last_document_id;
+		}
+		if (posting_offsets.begin()[term_id + 1U] != posting_offsets.begin()[term_id] + posting_count) {
+			return false;
+		}
+	}
+
+	return is_sorted(layout_.document_ids.begin(), layout_.document_ids.end());
+}
+
+const PostingBlock* ImmutableSegment::FindBlock(TermId term_id, int64_t document_id) const {
+	const PostingBlock* const first = layout_.blocks.begin() + layout_.block_offsets.begin()[term_id];
+	const PostingBlock* const last = layout_.blocks.begin() + layout_.block_offsets.begin()[term_id + 1U];
+
+	return lower_bound(first, last, document_id, [](const PostingBlock& block, int64_t id) {
+		return block.last_document_id < id;
+	});
+}
+
+void ImmutableSegment::DecodeDocumentIds(const PostingBlock& block, int* document_ids) const {
+	const uint64_t* const words = layout_.packed_data.begin() + block.data_offset;
+	document_ids[0] = block.first_document_id;
+	size_t bit_position = 0;
+	for (size_t i = 1; i < block.posting_count; ++i) {
+		document_ids[i] = document_ids[i - 1U] + 1 + static_cast<int>(ReadBits(words, bit_position, block.gap_bits));
+		bit_position += block.gap_bits;
+	}
+}
+
+void ImmutableSegment::DecodeBlock(const PostingBlock& block, int* document_ids, double* term_freqs) const {
+	DecodeDocumentIds(block, document_ids);
+	const uint64_t* const words = layout_.packed_data.begin() + block.data_offset;
+	const double* const distinct_term_freqs = layout_.term_freqs.begin() + block.term_freq_offset;
+	size_t bit_position = (block.posting_count - 1U) * size_t{block.gap_bits};
+	for (size_t i = 0; i < block.posting_count; ++i) {
+		term_freqs[i] = distinct_term_freqs[ReadBits(words, bit_position, block.term_freq_bits)];
+		bit_position += block.term_freq_bits;
+	}
+}
@@ -0,0 +1,419 @@
+#include "../inc/inverted_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <tuple>
+
+using namespace std;
+
+InvertedIndex::InvertedIndex(const InvertedIndex& other)
+	: terms_(other.terms_)
+	, document_freqs_(other.document_freqs_)
+	, postings_(other.postings_)
+	, max_term_freqs_(other.max_term_freqs_)
+	, mutable_posting_count_(other.mutable_posting_count_.load(memory_order_relaxed))
+	, sealed_(other.sealed_)
+	, policy_(other.policy_) {
+}
+
+InvertedIndex::InvertedIndex(InvertedIndex&& other) noexcept
+	: terms_(move(other.terms_))
+	, document_freqs_(move(other.document_freqs_))
+	, postings_(move(other.postings_))
+	, max_term_freqs_(move(other.max_term_freqs_))
+	, mutable_posting_count_(other.mutable_posting_count_.exchange(0U, memory_order_relaxed))
+	, sealed_(move(other.sealed_))
+	, pending_merges_(move(other.pending_merges_))
+	, policy_(other.policy_) {
+}
+
+InvertedIndex& InvertedIndex::operator=(InvertedIndex&& other) noexcept {
+	terms_ = move(other.terms_);
+	document_freqs_ = move(other.document_freqs_);
+	postings_ = move(other.postings_);
+	max_term_freqs_ = move(other.max_term_freqs_);
+	mutable_posting_count_.store(other.mutable_posting_count_.exchange(0U, memory_order_relaxed), memory_order_relaxed);
+	sealed_ = move(other.sealed_);
+	pending_merges_ = move(other.pending_merges_);
+	policy_ = other.policy_;
+
+	return *this;
+}
+
+InvertedIndex::InvertedIndex(const shared_ptr<const MappedFile>& file, const IndexFileHeader& header) {
+	const uint64_t* term_offsets = GetOffsetsData(*file, header.term_offsets, header.term_text.count);
+	const TermId term_count = static_cast<TermId>(header.term_offsets.count - 1U);
+	if (header.term_offsets.count - 1U >= NO_TERM || header.posting_offsets.count != header.term_offsets.count) {
+		ThrowCorruptedIndexFile();
+	}
+
+	ImmutableSegment::Layout layout;
+	layout.posting_offsets = MakeSectionRange<uint64_t>(*file, header.posting_offsets);
+	layout.block_offsets = MakeSectionRange<uint64_t>(*file, header.block_offsets);
+	layout.blocks = MakeSectionRange<PostingBlock>(*file, header.posting_blocks);
+	layout.packed_data = MakeSectionRange<uint64_t>(*file, header.packed_postings);
+	layout.term_freqs = MakeSectionRange<double>(*file, header.term_freqs);
+	layout.document_ids = MakeSectionRange<int>(*file, header.posting_document_ids);
+	auto segment = make_shared<const ImmutableSegment>(file, layout);
+	if (!segment->IsConsistent()) {
+		ThrowCorruptedIndexFile();
+	}
+
+	terms_ = TermDictionary(file, term_offsets, GetSectionData<char>(*file, header.term_text), term_count);
+	document_freqs_.resize(term_count);
+	for (TermId term_id = 0; term_id < term_count; ++term_id) {
+		document_freqs_[term_id] = segment->GetPostingCount(term_id);
+	}
+	sealed_.push_back({move(segment), {}});
+}
+
+void SegmentView::OpenCursor(TermId term_id, PostingCursor& cursor) const {
+	if (segment_ != nullptr) {
+		cursor.Open(*segment_, term_id);
+	} else {
+		const PostingRange postings = index_->GetMutablePostings(term_id);
+		cursor.Open(postings, postings.size() > 0U ? index_->max_term_freqs_[term_id] : 0.0);
+	}
+}
+
+bool SegmentView::Contains(TermId term_id, int document_id) const {
+	if (segment_ != nullptr) {
+		return segment_->HasPosting(term_id, document_id);
+	}
+	const PostingRange postings = index_->GetMutablePostings(term_id);
+
+	return FindPosting(postings, document_id) != postings.end();
+}
+
+bool SegmentView::IsDeleted(int document_id) const {
+	return deleted_ != nullptr && !deleted_->empty() && deleted_->count(document_id) > 0U;
+}
+
+TermId InvertedIndex::AddTerm(string_view term) {
+	const TermId term_id = terms_.Insert(term);
+	// A loaded index gets its mutable rows with the first new term
+	if (term_id >= postings_.size()) {
+		postings_.resize(term_id + 1U);
+		max_term_freqs_.resize(term_id + 1U);
+		document_freqs_.resize(max(document_freqs_.size(), postings_.size()));
+	}
+
+	return term_id;
+}
+
+void InvertedIndex::RemoveTerm(TermId term_id) {
+	terms_.Erase(term_id);
+	if (term_id < postings_.size()) {
+		PostingList().swap(postings_[term_id]);
+		max_term_freqs_[term_id] = 0.0;
+	}
+}
+
+TermId InvertedIndex::FindTerm(string_view term) const {
+	return terms_.Find(term);
+}
+
+string_view InvertedIndex::GetTerm(TermId term_id) const {
+	return terms_.GetTerm(term_id);
+}
+
+size_t InvertedIndex::GetTermCount() const {
+	return terms_.GetSize();
+}
+
+TermMemoryUsage InvertedIndex::GetTermMemoryUsage() const {
+	return terms_.GetMemoryUsage();
+}
+
+void InvertedIndex::AddPosting(TermId term_id, int document_id, double term_freq) {
+	auto& postings = postings_[term_id];
+	++document_freqs_[term_id];
+	mutable_posting_count_.fetch_add(1U, memory_order_relaxed);
+	max_term_freqs_[term_id] = max(max_term_freqs_[term_id], term_freq);
+	// Documents usually arrive in ascending id order, so appending is the common case
+	if (postings.empty() || postings.back().document_id < document_id) {
+		postings.push_back({document_id, term_freq});
+		return;
+	}
+
+	const auto it = lower_bound(postings.begin(), postings.end(), document_id, [](const Posting& posting, int id) {
+		return posting.document_id < id;
+	});
+	postings.insert(it, {document_id, term_freq});
+}
+
+void InvertedIndex::AddPostings(TermId term_id, const PostingList& postings) {
+	auto& target = postings_[term_id];
+	document_freqs_[term_id] += postings.size();
+	mutable_posting_count_.fetch_add(postings.size(), memory_order_relaxed);
+	for (const Posting& posting : postings) {
+		max_term_freqs_[term_id] = max(max_term_freqs_[term_id], posting.term_freq);
+	}
+	const size_t old_size = target.size();
+	target.insert(target.end(), postings.begin(), postings.end());
+	if (old_size > 0U && !postings.empty() && postings.front().document_id < target[old_size - 1U].document_id) {
+		inplace_merge(target.begin(), target.begin() + old_size, target.end(), [](const Posting& lhs, const Posting& rhs) {
+			return lhs.document_id < rhs.document_id;
+		});
+	}
+}
+
+void InvertedIndex::RemovePosting(TermId term_id, int document_id) {
+	--document_freqs_[term_id];
+	if (term_id >= postings_.size()) {
+		return;
+	}
+	auto& postings = postings_[term_id];
+	const Posting* it = FindPosting(MakePostingRange(postings), document_id);
+	if (it != postings.data() + postings.size()) {
+		postings.erase(postings.begin() + (it - postings.data()));
+		mutable_posting_count_.fetch_sub(1U, memory_order_relaxed);
+	}
+}
+
+void InvertedIndex::DeleteDocument(int document_id) {
+	for (SealedSegment& sealed : sealed_) {
+		if (sealed.segment->HasDocument(document_id)) {
+			sealed.deleted.insert(document_id);
+		}
+	}
+}
+
+size_t InvertedIndex::GetDocumentFreq(TermId term_id) const {
+	return document_freqs_[term_id];
+}
+
+double InvertedIndex::GetMaxTermFreq(TermId term_id) const {
+	double max_term_freq = term_id < max_term_freqs_.size() ? max_term_freqs_[term_id] : 0.0;
+	for (const SealedSegment& sealed : sealed_) {
+		for (const PostingBlock& block : sealed.segment->GetBlocks(term_id)) {
+			max_term_freq = max(max_term_freq, sealed.segment->GetMaxTermFreq(block));
+		}
+	}
+
+	return max_term_freq;
+}
+
+bool InvertedIndex::Contains(TermId term_id, int document_id) const {
+	const PostingRange mutable_postings = GetMutablePostings(term_id);
+	if (FindPosting(mutable_postings, document_id) != mutable_postings.end()) {
+		return true;
+	}
+	for (const SealedSegment& sealed : sealed_) {
+		if (sealed.segment->HasPosting(term_id, document_id) && sealed.deleted.count(document_id) == 0U) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+vector<int> InvertedIndex::SampleDocumentIds(TermId term_id, size_t sample_count) const {
+	const size_t step = max(document_freqs_[term_id] / max(sample_count, size_t{1}), size_t{1});
+	vector<int> result;
+	size_t position = 0;
+	ForEachPosting(term_id, [&result, &position, step](const Posting& posting) {
+		if (position++ % step == 0U) {
+			result.push_back(posting.document_id);
+		}
+	});
+	// Segments are visited one after another, so their samples interleave
+	sort(result.begin(), result.end());
+
+	return result;
+}
+
+void InvertedIndex::SetSegmentPolicy(const SegmentPolicy& policy) {
+	policy_ = policy;
+	policy_.mutable_posting_limit = max(policy_.mutable_posting_limit, size_t{1});
+	policy_.merge_factor = max(policy_.merge_factor, size_t{2});
+}
+
+void InvertedIndex::Maintain() {
+	if (mutable_posting_count_.load(memory_order_relaxed) >= policy_.mutable_posting_limit) {
+		Flush();
+	} else {
+		InstallMerges(false);
+	}
+}
+
+void InvertedIndex::Flush() {
+	if (mutable_posting_count_.load(memory_order_relaxed) > 0U) {
+		sealed_.push_back({make_shared<const ImmutableSegment>(postings_), {}});
+		for (PostingList& row : postings_) {
+			PostingList().swap(row);
+		}
+		fill(max_term_freqs_.begin(), max_term_freqs_.end(), 0.0);
+		mutable_posting_count_.store(0U, memory_order_relaxed);
+	}
+	InstallMerges(false);
+	ScheduleMerges();
+}
+
+void InvertedIndex::WaitForMerges() {
+	while (!pending_merges_.empty()) {
+		InstallMerges(true);
+		ScheduleMerges();
+	}
+}
+
+size_t InvertedIndex::GetSegmentCount() const {
+	return sealed_.size();
+}
+
+void InvertedIndex::RenumberDocuments(const vector<int>& new_document_ids) {
+	vector<PostingList> rows(terms_.GetIdBound());
+	size_t posting_count = 0;
+	for (TermId term_id = 0; term_id < terms_.GetIdBound(); ++term_id) {
+		if (!terms_.IsLive(term_id)) {
+			continue;
+		}
+		PostingList& row = rows[term_id];
+		ForEachPosting(term_id, [&row, &new_document_ids](const Posting& posting) {
+			row.push_back({new_document_ids[posting.document_id], posting.term_freq});
+		});
+		// Segments are visited in the order they were sealed, not by document id
+		sort(row.begin(), row.end(), [](const Posting& lhs, const Posting& rhs) {
+			return lhs.document_id < rhs.document_id;
+		});
+		posting_count += row.size();
+	}
+
+	// Destroying a running merge waits for it; a deferred one never runs
+	pending_merges_.clear();
+	sealed_.clear();
+	if (posting_count > 0U) {
+		sealed_.push_back({make_shared<const ImmutableSegment>(rows), {}});
+	}
+	for (PostingList& row : postings_) {
+		PostingList().swap(row);
+	}
+	fill(max_term_freqs_.begin(), max_term_freqs_.end(), 0.0);
+	mutable_posting_count_.store(0U, memory_order_relaxed);
+}
+
+vector<TermId> InvertedIndex::Save(IndexFileWriter& writer, IndexFileHeader& header, const vector<int>& new_document_ids) const {
+	vector<pair<string_view, TermId>> terms;
+	for (TermId term_id = 0; term_id < terms_.GetIdBound(); ++term_id) {
+		if (terms_.IsLive(term_id)) {
+			terms.push_back({terms_.GetTerm(term_id), term_id});
+		}
+	}
+	sort(terms.begin(), terms.end());
+
+	vector<TermId> new_ids(terms_.GetIdBound(), NO_TERM);
+	vector<string_view> term_texts;
+	term_texts.reserve(terms.size());
+	vector<PostingList> rows(terms.size());
+	for (const auto& [term, term_id] : terms) {
+		PostingList& row = rows[term_texts.size()];
+		new_ids[term_id] = static_cast<TermId>(term_texts.size());
+		term_texts.push_back(term);
+		ForEachPosting(term_id, [&row, &new_document_ids](const Posting& posting) {
+			row.push_back({new_document_ids[posting.document_id], posting.term_freq});
+		});
+		sort(row.begin(), row.end(), [](const Posting& lhs, const Posting& rhs) {
+			return lhs.document_id < rhs.document_id;
+		});
+	}
+	const ImmutableSegment segment(rows);
+	const ImmutableSegment::Layout& layout = segment.GetLayout();
+
+	tie(header.term_offsets, header.term_text) = writer.WriteStrings(term_texts);
+	header.posting_offsets = writer.Write(layout.posting_offsets);
+	header.block_offsets = writer.Write(layout.block_offsets);
+	header.posting_blocks = writer.Write(layout.blocks);
+	header.packed_postings = writer.Write(layout.packed_data);
+	header.term_freqs = writer.Write(layout.term_freqs);
+	header.posting_document_ids = writer.Write(layout.document_ids);
+
+	return new_ids;
+}
+
+PostingRange InvertedIndex::GetMutablePostings(TermId term_id) const {
+	if (term_id >= postings_.size()) {
+		return {nullptr, nullptr};
+	}
+
+	return MakePostingRange(postings_[term_id]);
+}
+
+void InvertedIndex::InstallMerges(bool wait) {
+	for (auto merge = pending_merges_.begin(); merge != pending_merges_.end();) {
+		if (!wait && merge->result.wait_for(chrono::seconds(0)) != future_status::ready) {
+			++merge;
+			continue;
+		}
+
+		SealedSegment merged{merge->result.get(), {}};
+		for (const auto& input : merge->inputs) {
+			const auto it = find_if(sealed_.begin(), sealed_.end(), [&input](const SealedSegment& sealed) {
+				return sealed.segment == input.segment;
+			});
+			// Documents deleted while the merge was running are still in the merged segment
+			for (const int document_id : it->deleted) {
+				if (input.deleted.count(document_id) == 0U) {
+					merged.deleted.insert(document_id);
+				}
+			}
+			sealed_.erase(it);
+		}
+		sealed_.push_back(move(merged));
+		merge = pending_merges_.erase(merge);
+	}
+}
+
+void InvertedIndex::ScheduleMerges() {
+	for (bool scheduled = true; scheduled;) {
+		scheduled = false;
+		vector<vector<const SealedSegment*>> tiers;
+		for (const SealedSegment& sealed : sealed_) {
+			if (IsMerging(sealed.segment.get())) {
+				continue;
+			}
+			const size_t tier = GetSizeTier(*sealed.segment);
+			if (tier >= tiers.size()) {
+				tiers.resize(tier + 1U);
+			}
+			tiers[tier].push_back(&sealed);
+		}
+
+		for (const auto& tier : tiers) {
+			if (tier.size() < policy_.merge_factor) {
+				continue;
+			}
+			PendingMerge merge;
+			for (size_t i = 0; i < policy_.merge_factor; ++i) {
+				merge.inputs.push_back({tier[i]->segment, tier[i]->deleted});
+			}
+			// The task owns copies of its inputs, so it never touches the index itself
+			merge.result = async(policy_.background_merges ? launch::async : launch::deferred, [inputs = merge.inputs]() {
+				return make_shared<const ImmutableSegment>(inputs);
+			});
+			pending_merges_.push_back(move(merge));
+			scheduled = true;
+			break;
+		}
+
+		if (!policy_.background_merges) {
+			InstallMerges(true);
+		}
+	}
+}
+
+size_t InvertedIndex::GetSizeTier(const ImmutableSegment& segment) const {
+	size_t tier = 0;
+	for (size_t bound = policy_.mutable_posting_limit * policy_.merge_factor; segment.GetPostingCount() >= bound; bound *= policy_.merge_factor) {
+		++tier;
+	}
+
+	return tier;
+}
+
+bool InvertedIndex::IsMerging(const ImmutableSegment* segment) const {
+	return any_of(pending_merges_.begin(), pending_merges_.end(), [segment](const PendingMerge& merge) {
+		return any_of(merge.inputs.begin(), merge.inputs.end(), [segment](const ImmutableSegment::MergeInput& input) {
+			return input.segment.get() == segment;
+		});
+	});
+}
@@ -0,0 +1,90 @@
+#include "../inc/posting_cursor.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+bool IsBlockBefore(const PostingBlock& block, int64_t document_id) {
+	return block.last_document_id < document_id;
+}
+
+} // namespace
+
+void PostingCursor::Open(const ImmutableSegment& segment, TermId term_id) {
+	const IteratorRange<const PostingBlock*> blocks = segment.GetBlocks(term_id);
+	segment_ = &segment;
+	block_ = blocks.begin();
+	shallow_block_ = blocks.begin();
+	last_block_ = blocks.end();
+	max_term_freq_ = 0.0;
+	for (const PostingBlock& block : blocks) {
+		max_term_freq_ = max(max_term_freq_, segment.GetMaxTermFreq(block));
+	}
+	DecodeBlock();
+}
+
+void PostingCursor::Open(PostingRange postings, double max_term_freq) {
+	segment_ = nullptr;
+	postings_ = postings;
+	max_term_freq_ = max_term_freq;
+	position_ = 0;
+	position_count_ = postings.size();
+	document_id_ = position_count_ > 0U ? postings.begin()->document_id : END;
+}
+
+void PostingCursor::Seek(int64_t document_id) {
+	if (document_id_ >= document_id) {
+		return;
+	}
+
+	if (segment_ == nullptr) {
+		position_ = lower_bound(postings_.begin() + position_, postings_.end(), document_id, [](const Posting& posting, int64_t id) {
+			return posting.document_id < id;
+		}) - postings_.begin();
+		document_id_ = position_ < position_count_ ? postings_.begin()[position_].document_id : END;
+		return;
+	}
+
+	if (block_->last_document_id < document_id) {
+		block_ = lower_bound(block_ + 1, last_block_, document_id, IsBlockBefore);
+		DecodeBlock();
+		if (document_id_ == END) {
+			return;
+		}
+	}
+	// The block ends at or after document_id, so the search stays inside it
+	position_ = lower_bound(document_ids_ + position_, document_ids_ + position_count_, document_id) - document_ids_;
+	document_id_ = document_ids_[position_];
+}
+
+double PostingCursor::SeekBlock(int64_t document_id) {
+	if (segment_ == nullptr) {
+		return position_ < position_count_ ? max_term_freq_ : 0.0;
+	}
+
+	shallow_block_ = lower_bound(max(shallow_block_, block_), last_block_, document_id, IsBlockBefore);
+
+	return shallow_block_ == last_block_ ? 0.0 : segment_->GetMaxTermFreq(*shallow_block_);
+}
+
+int64_t PostingCursor::GetBlockLastDocumentId() const {
+	if (segment_ == nullptr) {
+		return position_ < position_count_ ? postings_.end()[-1].document_id : END;
+	}
+
+	return shallow_block_ == last_block_ ? END : shallow_block_->last_document_id;
+}
+
+void PostingCursor::DecodeBlock() {
+	position_ = 0;
+	if (block_ == last_block_) {
+		position_count_ = 0;
+		document_id_ = END;
+		return;
+	}
+	segment_->DecodeBlock(*block_, document_ids_, term_freqs_);
+	position_count_ = block_->posting_count;
+	document_id_ = document_ids_[0];
+}
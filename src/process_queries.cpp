@@ -2,27 +2,143 @@
 
 #include <execution>
 #include <algorithm>
+#include <numeric>
 
 using namespace std;
 
-vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
-	vector<vector<Document>> results(queries.size());
+namespace {
+
+// Queries evaluated by one shared scan; bounds the accumulators a worker holds at once
+const size_t SHARED_GROUP_SIZE = 64;
+
+bool IsLess(const PreparedQuery& lhs, const PreparedQuery& rhs) {
+	const auto by_term_id = [](const auto& lhs, const auto& rhs) {
+		return lhs.term_id < rhs.term_id;
+	};
+	if (lexicographical_compare(lhs.plus_terms.begin(), lhs.plus_terms.end(), rhs.plus_terms.begin(), rhs.plus_terms.end(), by_term_id)) {
+		return true;
+	}
+	if (lexicographical_compare(rhs.plus_terms.begin(), rhs.plus_terms.end(), lhs.plus_terms.begin(), lhs.plus_terms.end(), by_term_id)) {
+		return false;
+	}
+	return lhs.minus_terms < rhs.minus_terms;
+}
+
+// The plus term with the longest posting list, which has the least inverse document frequency
+TermId GetLongestTerm(const PreparedQuery& query) {
+	const auto longest = min_element(query.plus_terms.begin(), query.plus_terms.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.inverse_document_freq < rhs.inverse_document_freq;
+	});
+
+	return longest == query.plus_terms.end() ? NO_TERM : longest->term_id;
+}
+
+vector<vector<Document>> SplitResults(const QueryBatchResults& batch) {
+	vector<vector<Document>> results;
+	results.reserve(batch.GetQueryCount());
+	for (size_t query_index = 0; query_index < batch.GetQueryCount(); ++query_index) {
+		const auto documents = batch.GetResults(query_index);
+		results.emplace_back(documents.begin(), documents.end());
+	}
+
+	return results;
+}
+
+} // namespace
+
+QueryBatchResults ProcessQueryBatch(const SearchServer& search_server, const vector<string>& queries) {
+	vector<PreparedQuery> prepared_queries(queries.size());
 
 	transform(execution::par,
 			  queries.begin(), queries.end(),
-			  results.begin(),
-			  [&search_server](const string& query) { return search_server.FindTopDocuments(query); }
+			  prepared_queries.begin(),
+			  [&search_server](const string& query) { return search_server.PrepareQuery(query); }
 			);
 
-	return results;
+	return ProcessQueryBatch(search_server, prepared_queries);
 }
 
-vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
-	vector<Document> result;
+QueryBatchResults ProcessQueryBatch(const SearchServer& search_server, const vector<PreparedQuery>& queries) {
+	// Distinct queries, each standing for all its copies in the batch
+	vector<size_t> order(queries.size());
+	iota(order.begin(), order.end(), 0U);
+	sort(order.begin(), order.end(), [&queries](size_t lhs, size_t rhs) {
+		return IsLess(queries[lhs], queries[rhs]);
+	});
+	vector<const PreparedQuery*> distinct_queries;
+	vector<size_t> distinct_indexes(queries.size());
+	for (const size_t query_index : order) {
+		if (distinct_queries.empty() || IsLess(*distinct_queries.back(), queries[query_index])) {
+			distinct_queries.push_back(&queries[query_index]);
+		}
+		distinct_indexes[query_index] = distinct_queries.size() - 1U;
+	}
+
+	// Groups of queries with the same longest posting list
+	vector<size_t> by_longest_term(distinct_queries.size());
+	iota(by_longest_term.begin(), by_longest_term.end(), 0U);
+	vector<TermId> longest_terms(distinct_queries.size());
+	transform(distinct_queries.begin(), distinct_queries.end(), longest_terms.begin(), [](const PreparedQuery* query) {
+		return GetLongestTerm(*query);
+	});
+	stable_sort(by_longest_term.begin(), by_longest_term.end(), [&longest_terms](size_t lhs, size_t rhs) {
+		return longest_terms[lhs] < longest_terms[rhs];
+	});
+	vector<vector<size_t>> groups;
+	for (size_t i = 0; i < by_longest_term.size(); ++i) {
+		const size_t distinct_index = by_longest_term[i];
+		const bool starts_group = i == 0U
+								  || longest_terms[distinct_index] == NO_TERM
+								  || longest_terms[distinct_index] != longest_terms[by_longest_term[i - 1U]]
+								  || groups.back().size() == SHARED_GROUP_SIZE;
+		if (starts_group) {
+			groups.emplace_back();
+		}
+		groups.back().push_back(distinct_index);
+	}
 
-	for(const auto& documents : ProcessQueries(search_server, queries)) {
-		result.insert(result.end(), documents.begin(), documents.end());
+	vector<vector<Document>> distinct_results(distinct_queries.size());
+	for_each(execution::par,
+			 groups.begin(), groups.end(),
+			 [&search_server, &distinct_queries, &distinct_results](const vector<size_t>& group) {
+				 if (group.size() == 1U) {
+					 search_server.FindTopDocuments(*distinct_queries[group[0]], distinct_results[group[0]]);
+					 return;
+				 }
+				 vector<const PreparedQuery*> group_queries;
+				 for (const size_t distinct_index : group) {
+					 group_queries.push_back(distinct_queries[distinct_index]);
+				 }
+				 vector<vector<Document>> group_results;
+				 search_server.FindTopDocumentsShared(group_queries, group_results);
+				 for (size_t i = 0; i < group.size(); ++i) {
+					 distinct_results[group[i]] = move(group_results[i]);
+				 }
+			 });
+
+	QueryBatchResults batch;
+	batch.offsets.reserve(queries.size() + 1U);
+	for (const size_t distinct_index : distinct_indexes) {
+		const vector<Document>& documents = distinct_results[distinct_index];
+		batch.documents.insert(batch.documents.end(), documents.begin(), documents.end());
+		batch.offsets.push_back(batch.documents.size());
 	}
 
-	return result;
-}
\ No newline at end of file
+	return batch;
+}
+
+vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
+	return SplitResults(ProcessQueryBatch(search_server, queries));
+}
+
+vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
+	return ProcessQueryBatch(search_server, queries).documents;
+}
+
+vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<PreparedQuery>& queries) {
+	return SplitResults(ProcessQueryBatch(search_server, queries));
+}
+
+vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<PreparedQuery>& queries) {
+	return ProcessQueryBatch(search_server, queries).documents;
+}
@@ -2,41 +2,148 @@
 
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server) 
+namespace {
+	atomic<uint64_t> queue_count = 0;
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, const RequestWindowOptions& options)
 	: search_server_(search_server)
-	, no_results_requests_(0)
-	, current_time_(0) {
+	, bucket_count_(max<size_t>(options.bucket_count, 1U))
+	, queue_id_(queue_count.fetch_add(1U, memory_order_relaxed))
+	, rings_(make_shared<RingList>()) {
+	bucket_width_ = max<Clock::duration>(options.window / bucket_count_, Clock::duration(1));
+}
+
+RequestQueue::RingList::~RingList() {
+	Ring* ring = head.load();
+	while (ring != nullptr) {
+		Ring* const next = ring->next;
+		delete ring;
+		ring = next;
+	}
 }
 
-vector<Document> RequestQueue::RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-	const auto result = search_server_.FindTopDocuments(raw_query, status);
-	AddRequest(result.size());
+vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
+	const Clock::time_point start = Clock::now();
+	auto result = search_server_.FindTopDocuments(raw_query, status);
+	const Clock::time_point end = Clock::now();
+	RecordRequest(result.size(), end - start, end);
 
 	return result;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
-	const auto result = search_server_.FindTopDocuments(raw_query);
-	AddRequest(result.size());
+	return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+}
 
-	return result;
+void RequestQueue::RecordRequest(size_t result_count, Clock::duration latency, Clock::time_point finish_time) {
+	const uint64_t epoch = GetEpoch(finish_time);
+	Bucket& bucket = GetThreadRing().buckets[epoch % bucket_count_];
+
+	// Only this thread writes the bucket, so plain loads and stores count exactly; readers
+	// racing with a roll-over see the old or the zeroed counts
+	const uint64_t bucket_epoch = bucket.epoch.load(memory_order_relaxed);
+	if (bucket_epoch > epoch) {
+		// The bucket already counts a later time
+		return;
+	}
+	if (bucket_epoch < epoch) {
+		bucket.request_count.store(0U, memory_order_relaxed);
+		bucket.no_result_count.store(0U, memory_order_relaxed);
+		for (atomic<uint64_t>& count : bucket.latency_counts) {
+			count.store(0U, memory_order_relaxed);
+		}
+		bucket.epoch.store(epoch, memory_order_release);
+	}
+
+	const auto increment = [](atomic<uint64_t>& count) {
+		count.store(count.load(memory_order_relaxed) + 1U, memory_order_relaxed);
+	};
+	increment(bucket.request_count);
+	if (result_count == 0U) {
+		increment(bucket.no_result_count);
+	}
+	increment(bucket.latency_counts[GetLatencyBucket(latency)]);
+}
+
+RequestStats RequestQueue::GetStats() const {
+	return GetStats(bucket_width_ * bucket_count_);
+}
+
+RequestStats RequestQueue::GetStats(Clock::duration window, Clock::time_point now) const {
+	const uint64_t last_epoch = GetEpoch(now);
+	const uint64_t window_buckets = min<uint64_t>(bucket_count_, max<uint64_t>((window + bucket_width_ - Clock::duration(1)) / bucket_width_, 1U));
+
+	RequestStats stats;
+	for (const Ring* ring = rings_->head.load(memory_order_acquire); ring != nullptr; ring = ring->next) {
+		for (size_t i = 0; i < bucket_count_; ++i) {
+			const Bucket& bucket = ring->buckets[i];
+			const uint64_t epoch = bucket.epoch.load(memory_order_acquire);
+			if (epoch == 0U || epoch > last_epoch || last_epoch - epoch >= window_buckets) {
+				continue;
+			}
+			stats.request_count += bucket.request_count.load(memory_order_relaxed);
+			stats.no_result_count += bucket.no_result_count.load(memory_order_relaxed);
+			for (size_t j = 0; j < LATENCY_BUCKET_COUNT; ++j) {
+				stats.latency_counts[j] += bucket.latency_counts[j].load(memory_order_relaxed);
+			}
+		}
+	}
+
+	return stats;
 }
 
 int RequestQueue::GetNoResultRequests() const {
-	return no_results_requests_;
+	return static_cast<int>(GetStats().no_result_count);
+}
+
+size_t RequestQueue::GetThreadRingCount() {
+	return GetThreadRings().size();
 }
 
-void RequestQueue::AddRequest(int results_num) {
-	++current_time_;
+vector<RequestQueue::ThreadRing>& RequestQueue::GetThreadRings() {
+	thread_local vector<ThreadRing> thread_rings;
 
-	while (!requests_.empty() && sec_in_day_ <= current_time_ - requests_.front().timestamp) {
-		if (0 == requests_.front().results) {
-			--no_results_requests_;
+	return thread_rings;
+}
+
+RequestQueue::Ring& RequestQueue::GetThreadRing() {
+	// Rings of this thread by queue id. Entries of destroyed queues are dropped on the way,
+	// so the scan stays as long as the number of live queues the thread records into.
+	vector<ThreadRing>& thread_rings = GetThreadRings();
+	for (size_t i = 0; i < thread_rings.size();) {
+		if (thread_rings[i].queue_id == queue_id_) {
+			return *thread_rings[i].ring;
 		}
-		requests_.pop_front();
-	}	
-	requests_.push_back({current_time_, results_num});
-	if (0 == results_num) {
-		++no_results_requests_;
+		if (thread_rings[i].owner.expired()) {
+			thread_rings[i] = move(thread_rings.back());
+			thread_rings.pop_back();
+		} else {
+			++i;
+		}
+	}
+
+	// First request of this thread: publish a new ring to the readers
+	Ring* ring = new Ring;
+	ring->buckets = make_unique<Bucket[]>(bucket_count_);
+	ring->next = rings_->head.load(memory_order_relaxed);
+	while (!rings_->head.compare_exchange_weak(ring->next, ring, memory_order_release, memory_order_relaxed)) {
 	}
-}
\ No newline at end of file
+	thread_rings.push_back({queue_id_, rings_, ring});
+
+	return *ring;
+}
+
+uint64_t RequestQueue::GetEpoch(Clock::time_point time) const {
+	return static_cast<uint64_t>(max<Clock::rep>(time.time_since_epoch() / bucket_width_, 0)) + 1U;
+}
+
+size_t RequestQueue::GetLatencyBucket(Clock::duration latency) {
+	const int64_t microseconds = chrono::duration_cast<chrono::microseconds>(latency).count();
+	size_t bucket = 0;
+	while (bucket + 1U < LATENCY_BUCKET_COUNT && (int64_t(1) << bucket) <= microseconds) {
+		++bucket;
+	}
+
+	return bucket;
+}
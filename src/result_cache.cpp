@@ -0,0 +1,108 @@
+#include "../inc/result_cache.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ResultCache::ResultCache(size_t capacity)
+	: capacity_(capacity)
+	, shard_count_(clamp(capacity, size_t{1}, MAX_SHARD_COUNT)) {
+	shards_ = make_unique<Shard[]>(shard_count_);
+	// Shard capacities add up to the capacity exactly
+	for (size_t i = 0; i < shard_count_; ++i) {
+		shards_[i].capacity = capacity / shard_count_ + (i < capacity % shard_count_ ? 1U : 0U);
+	}
+}
+
+void ResultCache::MakeKey(const PreparedQuery& query, DocumentStatus status, Key& key) {
+	key.clear();
+	key.push_back(static_cast<uint32_t>(status));
+	key.push_back(static_cast<uint32_t>(query.plus_terms.size()));
+	for (const auto& term : query.plus_terms) {
+		key.push_back(term.term_id);
+	}
+	key.insert(key.end(), query.minus_terms.begin(), query.minus_terms.end());
+}
+
+bool ResultCache::Find(const Key& key, uint64_t generation, vector<Document>& result) {
+	Shard& shard = GetShard(key);
+	{
+		lock_guard guard(shard.mutex);
+		const auto position = shard.positions.find(key);
+		if (position != shard.positions.end()) {
+			const auto entry = position->second;
+			if (entry->generation == generation) {
+				shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+				result.assign(entry->documents.begin(), entry->documents.end());
+				hits_.fetch_add(1U, memory_order_relaxed);
+				return true;
+			}
+			shard.positions.erase(position);
+			shard.entries.erase(entry);
+		}
+	}
+	misses_.fetch_add(1U, memory_order_relaxed);
+
+	return false;
+}
+
+void ResultCache::Insert(const Key& key, uint64_t generation, const vector<Document>& documents) {
+	Shard& shard = GetShard(key);
+	lock_guard guard(shard.mutex);
+	if (shard.capacity == 0U) {
+		return;
+	}
+	const auto position = shard.positions.find(key);
+	if (position != shard.positions.end()) {
+		// Another thread computed the same query meanwhile
+		const auto entry = position->second;
+		entry->generation = generation;
+		entry->documents = documents;
+		shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+		return;
+	}
+	if (shard.entries.size() == shard.capacity) {
+		shard.positions.erase(shard.entries.back().key);
+		shard.entries.pop_back();
+	}
+	shard.entries.push_front({key, generation, documents});
+	shard.positions.emplace(key, shard.entries.begin());
+}
+
+void ResultCache::Clear() {
+	for (size_t i = 0; i < shard_count_; ++i) {
+		lock_guard guard(shards_[i].mutex);
+		shards_[i].positions.clear();
+		shards_[i].entries.clear();
+	}
+}
+
+size_t ResultCache::GetCapacity() const {
+	return capacity_;
+}
+
+ResultCacheStats ResultCache::GetStats() const {
+	ResultCacheStats stats;
+	stats.hits = hits_.load(memory_order_relaxed);
+	stats.misses = misses_.load(memory_order_relaxed);
+	for (size_t i = 0; i < shard_count_; ++i) {
+		lock_guard guard(shards_[i].mutex);
+		stats.size += shards_[i].entries.size();
+	}
+
+	return stats;
+}
+
+size_t ResultCache::KeyHash::operator()(const Key& key) const {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const uint32_t value : key) {
+		hash = (hash ^ value) * 0x100000001b3ULL;
+	}
+
+	return static_cast<size_t>(hash);
+}
+
+ResultCache::Shard& ResultCache::GetShard(const Key& key) {
+	// The low bits pick the bucket inside the shard, so the shard takes the high ones
+	return shards_[(KeyHash()(key) >> 32U) % shard_count_];
+}
@@ -0,0 +1,130 @@
+#include "../inc/search_executor.h"
+
+using namespace std;
+
+struct SearchExecutor::SplitQuery {
+	PreparedQuery query;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	vector<int64_t> bounds;
+	// Results and errors of every range, written by its task only
+	vector<TopDocuments> tops;
+	vector<exception_ptr> errors;
+	atomic<size_t> remaining_count = 0;
+	Callback callback;
+};
+
+SearchExecutor::SearchExecutor(const SearchServer& search_server, const SearchExecutorOptions& options)
+	: search_server_(search_server)
+	, options_(options)
+	, pool_(options.thread_count > 0U ? options.thread_count : max(thread::hardware_concurrency(), 1U)) {
+	options_.ranges_per_thread = max<size_t>(options_.ranges_per_thread, 1U);
+}
+
+future<vector<Document>> SearchExecutor::Submit(string raw_query, DocumentStatus status) {
+	auto promise = make_shared<std::promise<vector<Document>>>();
+	future<vector<Document>> result = promise->get_future();
+	const bool is_accepted = Submit(move(raw_query), status, [promise](vector<Document> documents, exception_ptr error) {
+		if (error) {
+			promise->set_exception(error);
+		} else {
+			promise->set_value(move(documents));
+		}
+	});
+	if (!is_accepted) {
+		promise->set_exception(make_exception_ptr(QueryRejectedError("Search executor is saturated"s)));
+	}
+
+	return result;
+}
+
+bool SearchExecutor::Submit(string raw_query, DocumentStatus status, Callback callback) {
+	size_t pending_count = pending_count_.load();
+	do {
+		if (pending_count >= options_.max_pending_queries) {
+			rejected_count_.fetch_add(1U, memory_order_relaxed);
+			return false;
+		}
+	} while (!pending_count_.compare_exchange_weak(pending_count, pending_count + 1U));
+	accepted_count_.fetch_add(1U, memory_order_relaxed);
+
+	pool_.Submit([this, raw_query = move(raw_query), status, callback = move(callback)]() {
+		RunQuery(raw_query, status, callback);
+	});
+
+	return true;
+}
+
+size_t SearchExecutor::GetPendingQueryCount() const {
+	return pending_count_.load();
+}
+
+SearchExecutorStats SearchExecutor::GetStats() const {
+	return {accepted_count_.load(), rejected_count_.load(), split_count_.load()};
+}
+
+void SearchExecutor::RunQuery(const string& raw_query, DocumentStatus status, const Callback& callback) {
+	vector<Document> result;
+	try {
+		PreparedQuery query = search_server_.PrepareQuery(raw_query);
+		const size_t thread_count = pool_.GetThreadCount();
+		if (thread_count > 1U && search_server_.GetPostingCount(query) >= options_.split_posting_count) {
+			vector<int64_t> bounds = search_server_.SplitDocumentIds(query, thread_count * options_.ranges_per_thread);
+			const size_t range_count = bounds.size() - 1U;
+			if (range_count > 1U) {
+				split_count_.fetch_add(1U, memory_order_relaxed);
+				auto split = make_shared<SplitQuery>();
+				split->query = move(query);
+				split->status = status;
+				split->bounds = move(bounds);
+				split->tops.assign(range_count, TopDocuments(search_server_.GetMaxResultDocumentCount()));
+				split->errors.resize(range_count);
+				split->remaining_count = range_count;
+				split->callback = callback;
+				// Idle workers steal the other ranges from this worker's deque
+				for (size_t i = 1; i < range_count; ++i) {
+					pool_.Submit([this, split, i]() {
+						RunRange(split, i);
+					});
+				}
+				RunRange(split, 0U);
+				return;
+			}
+		}
+		search_server_.FindTopDocuments(query, status, result);
+	} catch (...) {
+		Finish(callback, {}, current_exception());
+		return;
+	}
+	Finish(callback, move(result), nullptr);
+}
+
+void SearchExecutor::RunRange(const shared_ptr<SplitQuery>& split, size_t range_index) {
+	try {
+		search_server_.FindRangeDocuments(split->query, split->status, split->bounds, range_index, split->tops[range_index]);
+	} catch (...) {
+		split->errors[range_index] = current_exception();
+	}
+	if (split->remaining_count.fetch_sub(1U, memory_order_acq_rel) != 1U) {
+		return;
+	}
+
+	// The last range merges the results of all of them
+	for (const exception_ptr& error : split->errors) {
+		if (error) {
+			Finish(split->callback, {}, error);
+			return;
+		}
+	}
+	TopDocuments top_documents(search_server_.GetMaxResultDocumentCount());
+	for (const TopDocuments& partial_top : split->tops) {
+		top_documents.Merge(partial_top);
+	}
+	vector<Document> result;
+	top_documents.ExtractTo(result);
+	Finish(split->callback, move(result), nullptr);
+}
+
+void SearchExecutor::Finish(const Callback& callback, vector<Document> documents, exception_ptr error) {
+	callback(move(documents), error);
+	pending_count_.fetch_sub(1U);
+}
@@ -1,28 +1,169 @@
 #include "../inc/search_server.h"
 
-#include <atomic>
+#include <exception>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
 
 using namespace std;
 
+namespace {
+
+struct TokenizedDocument {
+	const RawDocument* source;
+	int internal_id;
+	// Words point into the source text until they are interned
+	map<string_view, double> word_freqs;
+};
+
+// Inverted index over one slice of a batch, built by a single worker
+struct PartialIndex {
+	vector<TokenizedDocument> documents;
+	unordered_map<string_view, PostingList> word_to_postings;
+	exception_ptr error;
+};
+
+} // namespace
+
 SearchServer::SearchServer(const string& stop_words_text) 
 	: SearchServer(SplitIntoWords(stop_words_text)) { // Invoke delegating constructor
 	// from string container
 }
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-	if ((document_id < 0) || (documents_.count(document_id) > 0U)) {
+	if ((document_id < 0) || (internal_ids_.count(document_id) > 0U)) {
 		throw invalid_argument("Invalid document_id"s);
 	}
 	const auto words = SplitIntoWordsNoStop(document);
+	ReserveInternalIds(1U);
+	const int internal_id = AddInternalId(document_id);
 
 	const double inv_word_count = 1.0 / words.size();
+	map<TermId, double> term_freqs;
 	for (const string_view word : words) {
-		auto result = all_words_.insert(static_cast<string>(word));
-		word_to_document_freqs_[*result.first][document_id] += inv_word_count;
-		word_to_document_freqs_on_id_[document_id][*result.first] += inv_word_count;
+		term_freqs[index_.AddTerm(word)] += inv_word_count;
 	}
-	documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+
+	vector<DocumentTerm> document_terms;
+	document_terms.reserve(term_freqs.size());
+	for (const auto [term_id, term_freq] : term_freqs) {
+		index_.AddPosting(term_id, internal_id, term_freq);
+		document_terms.push_back({term_id, term_freq});
+	}
+	document_terms_.push_back(MakeDocumentTerms(move(document_terms)));
+	attributes_.Add(internal_id, ComputeAverageRating(ratings), status);
 	document_ids_.insert(document_id);
+	AddToChampionLists(internal_id, document_terms_.back());
+	++generation_;
+	index_.Maintain();
+}
+
+void SearchServer::AddDocumentBatch(const vector<const RawDocument*>& batch, bool parallel) {
+	vector<int> ids;
+	ids.reserve(batch.size());
+	for (const RawDocument* document : batch) {
+		if ((document->id < 0) || (internal_ids_.count(document->id) > 0U)) {
+			throw invalid_argument("Invalid document_id"s);
+		}
+		ids.push_back(document->id);
+	}
+	sort(ids.begin(), ids.end());
+	if (adjacent_find(ids.begin(), ids.end()) != ids.end()) {
+		throw invalid_argument("Invalid document_id"s);
+	}
+
+	ReserveInternalIds(batch.size());
+
+	// Tokenize and build partial indexes, one slice of the batch per worker
+	const size_t thread_count = max(thread::hardware_concurrency(), 1U);
+	const size_t part_count = min(batch.size(), parallel ? thread_count * 4U : size_t{1});
+	vector<PartialIndex> parts(part_count);
+	vector<size_t> part_indexes(part_count);
+	iota(part_indexes.begin(), part_indexes.end(), 0U);
+	// The batch gets consecutive internal ids in its own order
+	const int first_internal_id = static_cast<int>(external_ids_.size());
+	const auto build_part = [&batch, &parts, part_count, first_internal_id, this](size_t index) {
+		PartialIndex& part = parts[index];
+		try {
+			for (size_t i = batch.size() * index / part_count; i < batch.size() * (index + 1U) / part_count; ++i) {
+				const auto words = SplitIntoWordsNoStop(batch[i]->text);
+				const double inv_word_count = 1.0 / words.size();
+				const int internal_id = first_internal_id + static_cast<int>(i);
+				TokenizedDocument& document = part.documents.emplace_back(TokenizedDocument{batch[i], internal_id, {}});
+				for (const string_view word : words) {
+					document.word_freqs[word] += inv_word_count;
+				}
+				for (const auto [word, term_freq] : document.word_freqs) {
+					part.word_to_postings[word].push_back({internal_id, term_freq});
+				}
+			}
+			for (auto& [_, postings] : part.word_to_postings) {
+				sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+					return lhs.document_id < rhs.document_id;
+				});
+			}
+		} catch (...) {
+			part.error = current_exception();
+		}
+	};
+	if (parallel) {
+		for_each(execution::par, part_indexes.begin(), part_indexes.end(), build_part);
+	} else {
+		for_each(execution::seq, part_indexes.begin(), part_indexes.end(), build_part);
+	}
+	for (const PartialIndex& part : parts) {
+		if (part.error) {
+			rethrow_exception(part.error);
+		}
+	}
+
+	// Intern words serially, then merge posting lists of distinct terms concurrently
+	vector<pair<TermId, const PostingList*>> merges;
+	for (const PartialIndex& part : parts) {
+		for (const auto& [word, postings] : part.word_to_postings) {
+			merges.push_back({index_.AddTerm(word), &postings});
+		}
+	}
+	sort(merges.begin(), merges.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.first < rhs.first;
+	});
+	vector<size_t> term_starts;
+	for (size_t i = 0; i < merges.size(); ++i) {
+		if (i == 0U || merges[i].first != merges[i - 1U].first) {
+			term_starts.push_back(i);
+		}
+	}
+	const auto merge_term = [&merges, this](size_t start) {
+		for (size_t i = start; i < merges.size() && merges[i].first == merges[start].first; ++i) {
+			index_.AddPostings(merges[i].first, *merges[i].second);
+		}
+	};
+	if (parallel) {
+		for_each(execution::par, term_starts.begin(), term_starts.end(), merge_term);
+	} else {
+		for_each(execution::seq, term_starts.begin(), term_starts.end(), merge_term);
+	}
+
+	for (const PartialIndex& part : parts) {
+		for (const TokenizedDocument& document : part.documents) {
+			vector<DocumentTerm> document_terms;
+			document_terms.reserve(document.word_freqs.size());
+			for (const auto [word, term_freq] : document.word_freqs) {
+				document_terms.push_back({index_.FindTerm(word), term_freq});
+			}
+			sort(document_terms.begin(), document_terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+				return lhs.term_id < rhs.term_id;
+			});
+			AddInternalId(document.source->id);
+			document_terms_.push_back(MakeDocumentTerms(move(document_terms)));
+			attributes_.Add(document.internal_id, ComputeAverageRating(document.source->ratings), document.source->status);
+			document_ids_.insert(document.source->id);
+			AddToChampionLists(document.internal_id, document_terms_.back());
+		}
+	}
+	++generation_;
+	index_.Maintain();
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
@@ -33,18 +174,367 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
 	return FindTopDocuments(execution::seq, raw_query);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const {
+	return FindTopDocuments(execution::seq, query, status);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query) const {
+	return FindTopDocuments(execution::seq, query);
+}
+
+void SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, vector<Document>& result) const {
+	PreparedQuery& query = GetQueryScratch().query;
+	PrepareQuery(raw_query, query);
+	FindStatusDocuments(execution::seq, query, status, result);
+}
+
+void SearchServer::FindTopDocuments(string_view raw_query, vector<Document>& result) const {
+	FindTopDocuments(raw_query, DocumentStatus::ACTUAL, result);
+}
+
+void SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status, vector<Document>& result) const {
+	CheckPreparedQuery(query);
+	FindStatusDocuments(execution::seq, query, status, result);
+}
+
+void SearchServer::FindTopDocuments(const PreparedQuery& query, vector<Document>& result) const {
+	FindTopDocuments(query, DocumentStatus::ACTUAL, result);
+}
+
+void SearchServer::FindTopDocumentsShared(const vector<const PreparedQuery*>& queries, vector<vector<Document>>& results) const {
+	results.resize(queries.size());
+	// Block-Max WAND skips most of a row that is long compared with the number of results,
+	// so queries having such a row are searched separately
+	vector<const PreparedQuery*> scanned_queries;
+	vector<size_t> result_indexes;
+	for (size_t query_index = 0; query_index < queries.size(); ++query_index) {
+		const PreparedQuery& query = *queries[query_index];
+		CheckPreparedQuery(query);
+		size_t longest_row = 0;
+		for (const auto& term : query.plus_terms) {
+			longest_row = max(longest_row, index_.GetDocumentFreq(term.term_id));
+		}
+		if (longest_row > max_result_document_count_ * SHARED_SCAN_ROW_RATIO) {
+			FindAllDocuments(execution::seq, query, DocumentStatusFilter{DocumentStatus::ACTUAL}, results[query_index]);
+		} else {
+			scanned_queries.push_back(&query);
+			result_indexes.push_back(query_index);
+		}
+	}
+
+	struct SharedTerm {
+		TermId term_id;
+		uint32_t query_index;
+		double inverse_document_freq;
+		// Position among the plus terms of the query by ascending bound of relevance
+		size_t bound_rank;
+	};
+	struct SharedQuery {
+		// Sums of the smallest relevance bounds of the plus terms and of their document
+		// frequencies, one more value than terms
+		vector<double> bound_sums;
+		vector<size_t> document_freq_sums;
+		// Terms with the smallest bounds that can not lift a document into the results
+		// together. Their rows are not read for the query; documents having another term
+		// are scored from the forward index instead.
+		size_t non_essential_count = 0;
+	};
+	// Plus terms ordered by word keep the order of additions of every query, so relevances
+	// are the same as those of separate searches
+	vector<pair<string_view, SharedTerm>> plus_terms;
+	vector<SharedTerm> minus_terms;
+	vector<SharedQuery> shared_queries(scanned_queries.size());
+	vector<pair<double, size_t>> bounds;
+	for (uint32_t query_index = 0; query_index < scanned_queries.size(); ++query_index) {
+		const PreparedQuery& query = *scanned_queries[query_index];
+		SharedQuery& shared_query = shared_queries[query_index];
+		bounds.clear();
+		for (const auto& term : query.plus_terms) {
+			bounds.push_back({term.inverse_document_freq * index_.GetMaxTermFreq(term.term_id), plus_terms.size()});
+			plus_terms.push_back({term.word, {term.term_id, query_index, term.inverse_document_freq, 0U}});
+		}
+		sort(bounds.begin(), bounds.end());
+		shared_query.bound_sums.push_back(0.0);
+		shared_query.document_freq_sums.push_back(0U);
+		for (size_t rank = 0; rank < bounds.size(); ++rank) {
+			SharedTerm& term = plus_terms[bounds[rank].second].second;
+			term.bound_rank = rank;
+			shared_query.bound_sums.push_back(shared_query.bound_sums.back() + bounds[rank].first);
+			shared_query.document_freq_sums.push_back(shared_query.document_freq_sums.back() + index_.GetDocumentFreq(term.term_id));
+		}
+		for (const TermId term_id : query.minus_terms) {
+			minus_terms.push_back({term_id, query_index, 0.0, 0U});
+		}
+	}
+	sort(plus_terms.begin(), plus_terms.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second.query_index < rhs.second.query_index);
+	});
+	sort(minus_terms.begin(), minus_terms.end(), [](const SharedTerm& lhs, const SharedTerm& rhs) {
+		return lhs.term_id < rhs.term_id;
+	});
+	const auto is_essential = [&shared_queries](const SharedTerm& term) {
+		return term.bound_rank >= shared_queries[term.query_index].non_essential_count;
+	};
+
+	QueryScratch& scratch = GetQueryScratch();
+	vector<RelevanceAccumulator>& accumulators = scratch.shared_accumulators;
+	vector<TopDocuments>& tops = scratch.shared_tops;
+	vector<Posting>& postings = scratch.shared_postings;
+	if (accumulators.size() < scanned_queries.size()) {
+		accumulators.resize(scanned_queries.size());
+		tops.resize(scanned_queries.size(), TopDocuments(0U));
+	}
+	for (size_t query_index = 0; query_index < scanned_queries.size(); ++query_index) {
+		tops[query_index].Reset(max_result_document_count_);
+	}
+
+	const int id_bound = static_cast<int>(external_ids_.size());
+	for (int first_id = 0; first_id < id_bound; first_id += SHARED_SCAN_WINDOW) {
+		const int last_id = first_id + min(SHARED_SCAN_WINDOW, id_bound - first_id);
+		for (size_t query_index = 0; query_index < scanned_queries.size(); ++query_index) {
+			SharedQuery& shared_query = shared_queries[query_index];
+			// The results of the previous windows raise the bar
+			const auto first_sum = shared_query.bound_sums.begin() + 1;
+			size_t& non_essential_count = shared_query.non_essential_count;
+			non_essential_count = lower_bound(first_sum, shared_query.bound_sums.end(), tops[query_index].GetThreshold()) - first_sum;
+			// Scoring from the forward index costs more per document than a posting
+			size_t skipped_count = shared_query.document_freq_sums[non_essential_count];
+			const size_t posting_count = shared_query.document_freq_sums.back();
+			if (skipped_count < (posting_count - skipped_count) * SHARED_SCAN_SKIP_RATIO) {
+				non_essential_count = 0U;
+				skipped_count = 0U;
+			}
+			accumulators[query_index].Reset(first_id, last_id, (posting_count - skipped_count) * static_cast<size_t>(last_id - first_id) / static_cast<size_t>(id_bound));
+		}
+
+		// The postings of a row in the window are read once and then added query by query.
+		// Queries with non-essential terms only collect candidates from their other terms.
+		for (auto run = plus_terms.begin(); run != plus_terms.end();) {
+			const TermId term_id = run->second.term_id;
+			const auto run_end = find_if(run, plus_terms.end(), [term_id](const auto& term) {
+				return term.second.term_id != term_id;
+			});
+			const bool is_needed = any_of(run, run_end, [&is_essential](const auto& term) {
+				return is_essential(term.second);
+			});
+			if (!is_needed) {
+				run = run_end;
+				continue;
+			}
+			postings.clear();
+			index_.ForEachPosting(term_id, first_id, last_id, [&postings, this](const Posting& posting) {
+				if (attributes_.HasStatus(posting.document_id, DocumentStatus::ACTUAL)) {
+					postings.push_back(posting);
+				}
+			});
+			for (auto it = run; it != run_end; ++it) {
+				const SharedTerm& term = it->second;
+				RelevanceAccumulator& document_to_relevance = accumulators[term.query_index];
+				if (shared_queries[term.query_index].non_essential_count == 0U) {
+					for (const Posting& posting : postings) {
+						document_to_relevance.Add(posting.document_id, posting.term_freq * term.inverse_document_freq);
+					}
+				} else if (is_essential(term)) {
+					for (const Posting& posting : postings) {
+						document_to_relevance.Add(posting.document_id, 0.0);
+					}
+				}
+			}
+			run = run_end;
+		}
+
+		for (auto run = minus_terms.begin(); run != minus_terms.end();) {
+			const TermId term_id = run->term_id;
+			const auto run_end = find_if(run, minus_terms.end(), [term_id](const SharedTerm& term) {
+				return term.term_id != term_id;
+			});
+			index_.ForEachPosting(term_id, first_id, last_id, [&](const Posting& posting) {
+				for (auto it = run; it != run_end; ++it) {
+					accumulators[it->query_index].Exclude(posting.document_id);
+				}
+			});
+			run = run_end;
+		}
+
+		for (size_t query_index = 0; query_index < scanned_queries.size(); ++query_index) {
+			const PreparedQuery& query = *scanned_queries[query_index];
+			const bool is_candidate_only = shared_queries[query_index].non_essential_count > 0U;
+			TopDocuments& top_documents = tops[query_index];
+			accumulators[query_index].ForEach([&query, &top_documents, is_candidate_only, this](int internal_id, double relevance) {
+				if (is_candidate_only) {
+					// Same order of additions as the scan of full rows
+					const DocumentTerms& document_terms = document_terms_[internal_id];
+					for (const auto& term : query.plus_terms) {
+						if (const DocumentTerm* document_term = FindDocumentTerm(document_terms, term.term_id)) {
+							relevance += document_term->term_freq * term.inverse_document_freq;
+						}
+					}
+				}
+				top_documents.Add({external_ids_[internal_id], relevance, attributes_.GetRating(internal_id)});
+			});
+		}
+	}
+
+	for (size_t query_index = 0; query_index < scanned_queries.size(); ++query_index) {
+		tops[query_index].ExtractTo(results[result_indexes[query_index]]);
+	}
+}
+
 int SearchServer::GetDocumentCount() const {
-	return documents_.size();
+	return attributes_.GetSize();
+}
+
+void SearchServer::SetChampionListSize(size_t champion_count) {
+	champion_lists_ = ChampionLists(champion_count);
+	// Cached inverse document frequencies may differ from computed ones in the last bits
+	if (result_cache_.cache) {
+		result_cache_.cache->Clear();
+	}
+	if (!champion_lists_.IsEnabled()) {
+		return;
+	}
+	vector<TermId> term_ids;
+	for (const DocumentTerms& document_terms : document_terms_) {
+		for (const DocumentTerm& document_term : document_terms.terms) {
+			term_ids.push_back(document_term.term_id);
+		}
+	}
+	sort(term_ids.begin(), term_ids.end());
+	term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+	for (const TermId term_id : term_ids) {
+		champion_lists_.Rebuild(index_, term_id);
+	}
+	champion_lists_.SetDocumentCount(attributes_.GetSize());
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+	result_cache_.cache = capacity > 0U ? make_unique<ResultCache>(capacity) : nullptr;
+}
+
+ResultCacheStats SearchServer::GetResultCacheStats() const {
+	return result_cache_.cache ? result_cache_.cache->GetStats() : ResultCacheStats();
+}
+
+void SearchServer::SetMaxResultDocumentCount(size_t max_result_document_count) {
+	max_result_document_count_ = max_result_document_count;
+	if (result_cache_.cache) {
+		result_cache_.cache->Clear();
+	}
+}
+
+void SearchServer::SetSegmentPolicy(const SegmentPolicy& policy) {
+	index_.SetSegmentPolicy(policy);
+}
+
+void SearchServer::FlushIndex() {
+	index_.Flush();
+}
+
+void SearchServer::WaitForIndexMerges() {
+	index_.WaitForMerges();
+}
+
+size_t SearchServer::GetSegmentCount() const {
+	return index_.GetSegmentCount();
+}
+
+TermMemoryUsage SearchServer::GetTermMemoryUsage() const {
+	return index_.GetTermMemoryUsage();
+}
+
+size_t SearchServer::GetMaxResultDocumentCount() const {
+	return max_result_document_count_;
+}
+
+void SearchServer::Save(const string& path) const {
+	IndexFileWriter writer(path);
+	IndexFileHeader header;
+	tie(header.stop_word_offsets, header.stop_word_text) = writer.WriteStrings({stop_words_.begin(), stop_words_.end()});
+	// The file numbers live documents densely in the order of their external ids
+	vector<int> new_internal_ids(external_ids_.size(), -1);
+	int next_internal_id = 0;
+	for (const int document_id : document_ids_) {
+		new_internal_ids[internal_ids_.at(document_id)] = next_internal_id++;
+	}
+	const vector<TermId> new_term_ids = index_.Save(writer, header, new_internal_ids);
+
+	vector<DocumentRecord> documents;
+	documents.reserve(attributes_.GetSize());
+	vector<uint64_t> term_offsets = {0U};
+	term_offsets.reserve(attributes_.GetSize() + 1U);
+	vector<DocumentTerm> terms;
+	for (const int document_id : document_ids_) {
+		const int internal_id = internal_ids_.at(document_id);
+		documents.push_back({document_id, attributes_.GetRating(internal_id), static_cast<int32_t>(attributes_.GetStatus(internal_id)), 0});
+		const size_t list_begin = terms.size();
+		for (const DocumentTerm& term : document_terms_[internal_id].terms) {
+			terms.push_back({new_term_ids[term.term_id], term.term_freq});
+		}
+		// Renumbering changes the order of terms
+		sort(terms.begin() + list_begin, terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+			return lhs.term_id < rhs.term_id;
+		});
+		term_offsets.push_back(terms.size());
+	}
+	header.documents = writer.Write(documents);
+	header.document_term_offsets = writer.Write(term_offsets);
+	header.document_terms = writer.Write(terms);
+	writer.Finish(header);
+}
+
+SearchServer SearchServer::Load(const string& path) {
+	const auto file = make_shared<const MappedFile>(path);
+	const IndexFileHeader header = ReadIndexFileHeader(*file);
+
+	const uint64_t* stop_word_offsets = GetOffsetsData(*file, header.stop_word_offsets, header.stop_word_text.count);
+	const char* stop_word_text = GetSectionData<char>(*file, header.stop_word_text);
+	vector<string_view> stop_words;
+	for (uint64_t i = 0; i + 1U < header.stop_word_offsets.count; ++i) {
+		stop_words.push_back({stop_word_text + stop_word_offsets[i], stop_word_offsets[i + 1U] - stop_word_offsets[i]});
+	}
+	SearchServer search_server(stop_words);
+	search_server.index_ = InvertedIndex(file, header);
+
+	const DocumentRecord* documents = GetSectionData<DocumentRecord>(*file, header.documents);
+	const uint64_t* term_offsets = GetOffsetsData(*file, header.document_term_offsets, header.document_terms.count);
+	const DocumentTerm* terms = GetSectionData<DocumentTerm>(*file, header.document_terms);
+	if (header.document_term_offsets.count != header.documents.count + 1U) {
+		ThrowCorruptedIndexFile();
+	}
+	for (uint64_t i = 0; i < header.documents.count; ++i) {
+		const DocumentRecord& document = documents[i];
+		const bool is_valid = document.id >= 0 && (i == 0U || documents[i - 1U].id < document.id)
+			&& document.status >= static_cast<int32_t>(DocumentStatus::ACTUAL) && document.status <= static_cast<int32_t>(DocumentStatus::REMOVED);
+		if (!is_valid) {
+			ThrowCorruptedIndexFile();
+		}
+		// Documents are sorted by id, so every insertion goes to the end
+		const int internal_id = search_server.AddInternalId(document.id);
+		search_server.attributes_.Add(internal_id, document.rating, static_cast<DocumentStatus>(document.status));
+		search_server.document_ids_.emplace_hint(search_server.document_ids_.end(), document.id);
+		search_server.document_terms_.push_back(DocumentTerms{file, {terms + term_offsets[i], terms + term_offsets[i + 1U]}});
+	}
+
+	return search_server;
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const { 
-	if(word_to_document_freqs_on_id_.count(document_id) == 0U) {        
+	const auto internal_id = internal_ids_.find(document_id);
+	if (internal_id == internal_ids_.end()) {
 		const static map<string_view, double> result;
 
 		return result;
-	} else {
-		return word_to_document_freqs_on_id_.at(document_id);
 	}
+
+	lock_guard guard(word_frequencies_cache_.mutex);
+	const auto [word_freqs, inserted] = word_frequencies_cache_.documents.try_emplace(document_id);
+	if (inserted) {
+		for (const auto& [term_id, term_freq] : document_terms_[internal_id->second].terms) {
+			word_freqs->second.emplace(index_.GetTerm(term_id), term_freq);
+		}
+	}
+
+	return word_freqs->second;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
@@ -55,64 +545,67 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
 	return MatchDocument(execution::seq, raw_query, document_id);
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, string_view raw_query, int document_id) const {
-	const auto query = ParseQuery(raw_query);
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy& policy, string_view raw_query, int document_id) const {
+	return MatchDocument(policy, PrepareQuery(raw_query), document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy& policy, string_view raw_query, int document_id) const {
+	return MatchDocument(policy, PrepareQuery(raw_query), document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PreparedQuery& query, int document_id) const {
+	return MatchDocument(execution::seq, query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, const PreparedQuery& query, int document_id) const {
+	CheckPreparedQuery(query);
+	const int internal_id = GetInternalId(document_id);
+	const DocumentStatus status = attributes_.GetStatus(internal_id);
 	vector<string_view> matched_words;
 
-	for (const string_view word : query.plus_words) {
-		if (word_to_document_freqs_.count(word) == 0U) {
-			continue;
-		}
-		if (word_to_document_freqs_.at(word).count(document_id)) {
-			matched_words.push_back(word);
+	for (const TermId term_id : query.minus_terms) {
+		if (index_.Contains(term_id, internal_id)) {
+			return {matched_words, status};
 		}
 	}
 
-	for (const string_view word : query.minus_words) {
-		if (word_to_document_freqs_.count(word) == 0U) {
-			continue;
-		}
-		if (word_to_document_freqs_.at(word).count(document_id)) {
-			matched_words.clear();
-			break;
+	for (const auto& term : query.plus_terms) {
+		if (index_.Contains(term.term_id, internal_id)) {
+			matched_words.push_back(term.word);
 		}
 	}
 
-	return {matched_words, documents_.at(document_id).status};
+	return {matched_words, status};
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, string_view raw_query, int document_id) const {
-	const auto query = ParseQuery(raw_query);
-	vector<string_view> matched_words(query.plus_words.size());
-	atomic_int size = 0;
-
-	for_each(execution::par,
-			 query.plus_words.begin(), query.plus_words.end(),
-			 [&matched_words, &size, &document_id, this](const string_view word) {
-				 if (word_to_document_freqs_.count(word) == 0U) {
-					 return;
-				 }
-				 if (word_to_document_freqs_.at(word).count(document_id)) {
-					 matched_words[size++] = word;
-				 }
-			 });
-
-	matched_words.resize(size);
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const PreparedQuery& query, int document_id) const {
+	CheckPreparedQuery(query);
+	const int internal_id = GetInternalId(document_id);
+	const DocumentStatus status = attributes_.GetStatus(internal_id);
+	vector<string_view> matched_words;
 
-	for_each(execution::par,
-			 query.minus_words.begin(), query.minus_words.end(),
-			 [&matched_words, &document_id, this](const string_view word) {
-				 if (word_to_document_freqs_.count(word) == 0U) {
-					 return;
-				 }
-				 if (!matched_words.empty() && word_to_document_freqs_.at(word).count(document_id)) {
-					 matched_words.clear();
+	const bool has_minus_word = any_of(execution::par,
+									   query.minus_terms.begin(), query.minus_terms.end(),
+									   [internal_id, this](const TermId term_id) {
+										   return index_.Contains(term_id, internal_id);
+									   });
+	if (has_minus_word) {
+		return {matched_words, status};
+	}
 
-					 return;
-				 }
-			 });
+	vector<PreparedQuery::PlusTerm> matched_terms(query.plus_terms.size());
+	const auto matched_end = copy_if(execution::par,
+									 query.plus_terms.begin(), query.plus_terms.end(),
+									 matched_terms.begin(),
+									 [internal_id, this](const PreparedQuery::PlusTerm& term) {
+										 return index_.Contains(term.term_id, internal_id);
+									 });
+	matched_words.reserve(matched_end - matched_terms.begin());
+	for (auto it = matched_terms.begin(); it != matched_end; ++it) {
+		matched_words.push_back(it->word);
+	}
 
-	return {matched_words, documents_.at(document_id).status};
+	return {matched_words, status};
 }
 
 bool SearchServer::IsStopWord(string_view word) const {
@@ -127,18 +620,15 @@ bool SearchServer::IsValidWord(string_view word) {
 }
 
 vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-	vector<string_view> words;
-	for (const string_view word : SplitIntoWords(text)) {
-		if (!IsValidWord(word)) {
-			throw invalid_argument("Word "s + static_cast<string>(word) + " is invalid"s);
-		}
-		
-		if (!IsStopWord(word)) {
-			words.push_back(word);
-		}
+	TokenizedText tokens = Tokenize(text);
+	if (tokens.first_invalid_word < tokens.words.size()) {
+		throw invalid_argument("Word "s + static_cast<string>(tokens.words[tokens.first_invalid_word]) + " is invalid"s);
 	}
+	tokens.words.erase(remove_if(tokens.words.begin(), tokens.words.end(), [this](string_view word) {
+		return IsStopWord(word);
+	}), tokens.words.end());
 
-	return words;
+	return move(tokens.words);
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -154,7 +644,108 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
 	return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
+int SearchServer::GetInternalId(int document_id) const {
+	const auto it = internal_ids_.find(document_id);
+	if (it == internal_ids_.end()) {
+		throw out_of_range("Unknown document_id"s);
+	}
+
+	return it->second;
+}
+
+int SearchServer::AddInternalId(int document_id) {
+	const int internal_id = static_cast<int>(external_ids_.size());
+	external_ids_.push_back(document_id);
+	internal_ids_.emplace(document_id, internal_id);
+
+	return internal_id;
+}
+
+void SearchServer::CompactInternalIds() {
+	vector<int> new_internal_ids(external_ids_.size(), -1);
+	vector<int> external_ids;
+	external_ids.reserve(internal_ids_.size());
+	vector<DocumentTerms> document_terms;
+	document_terms.reserve(internal_ids_.size());
+	DocumentAttributes attributes;
+	for (size_t internal_id = 0; internal_id < external_ids_.size(); ++internal_id) {
+		// A removed id may be taken by a later document with the same external id
+		const auto it = internal_ids_.find(external_ids_[internal_id]);
+		if (it == internal_ids_.end() || it->second != static_cast<int>(internal_id)) {
+			continue;
+		}
+		const int new_internal_id = static_cast<int>(external_ids.size());
+		new_internal_ids[internal_id] = new_internal_id;
+		it->second = new_internal_id;
+		external_ids.push_back(external_ids_[internal_id]);
+		document_terms.push_back(move(document_terms_[internal_id]));
+		attributes.Add(new_internal_id, attributes_.GetRating(static_cast<int>(internal_id)), attributes_.GetStatus(static_cast<int>(internal_id)));
+	}
+
+	index_.RenumberDocuments(new_internal_ids);
+	external_ids_ = move(external_ids);
+	document_terms_ = move(document_terms);
+	attributes_ = move(attributes);
+	++generation_;
+	// Champion postings carry internal ids
+	if (champion_lists_.IsEnabled()) {
+		SetChampionListSize(champion_lists_.GetChampionCount());
+	}
+}
+
+void SearchServer::CompactInternalIdsIfSparse() {
+	const size_t removed_count = external_ids_.size() - internal_ids_.size();
+	if (removed_count >= MIN_COMPACTED_ID_COUNT && removed_count > internal_ids_.size()) {
+		CompactInternalIds();
+	}
+}
+
+void SearchServer::ReserveInternalIds(size_t document_count) {
+	const size_t id_limit = static_cast<size_t>(numeric_limits<int>::max());
+	if (external_ids_.size() + document_count <= id_limit) {
+		return;
+	}
+	CompactInternalIds();
+	if (external_ids_.size() + document_count > id_limit) {
+		throw length_error("Too many documents"s);
+	}
+}
+
+const SearchServer::DocumentTerm* SearchServer::FindDocumentTerm(const DocumentTerms& document_terms, TermId term_id) {
+	const DocumentTerm* it = lower_bound(document_terms.terms.begin(), document_terms.terms.end(), term_id, [](const DocumentTerm& document_term, TermId id) {
+		return document_term.term_id < id;
+	});
+
+	return (it != document_terms.terms.end() && it->term_id == term_id) ? it : nullptr;
+}
+
+void SearchServer::AddToChampionLists(int internal_id, const DocumentTerms& document_terms) {
+	if (!champion_lists_.IsEnabled()) {
+		return;
+	}
+	for (const DocumentTerm& document_term : document_terms.terms) {
+		champion_lists_.AddPosting(index_, document_term.term_id, {internal_id, document_term.term_freq});
+	}
+	champion_lists_.SetDocumentCount(attributes_.GetSize());
+}
+
+void SearchServer::RemoveFromChampionLists(int internal_id, const vector<TermId>& term_ids) {
+	if (!champion_lists_.IsEnabled()) {
+		return;
+	}
+	for (const TermId term_id : term_ids) {
+		champion_lists_.RemovePosting(index_, term_id, internal_id);
+	}
+	champion_lists_.SetDocumentCount(attributes_.GetSize());
+}
+
+SearchServer::DocumentTerms SearchServer::MakeDocumentTerms(vector<DocumentTerm> terms) {
+	const auto storage = make_shared<const vector<DocumentTerm>>(move(terms));
+
+	return {storage, {storage->data(), storage->data() + storage->size()}};
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text, bool is_valid) const {
 	if (text.empty()) {
 		throw invalid_argument("Query word is empty"s);
 	}
@@ -165,31 +756,115 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
 		text.remove_prefix(1);
 	}
 
-	if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+	if (text.empty() || text[0] == '-' || !is_valid) {
 		throw invalid_argument("Query word "s + static_cast<string>(text) + " is invalid"s);
 	}
 
 	return {text, is_minus, IsStopWord(text)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text) const {
-	Query result;
+PreparedQuery SearchServer::PrepareQuery(string_view text) const {
+	PreparedQuery result;
+	PrepareQuery(text, result);
+
+	return result;
+}
+
+void SearchServer::PrepareQuery(string_view text, PreparedQuery& result) const {
+	TokenizedText& tokens = GetQueryScratch().tokens;
+	result.plus_terms.clear();
+	result.minus_terms.clear();
+	result.server = this;
+	result.generation = generation_;
+
+	Tokenize(text, tokens);
+	for (size_t index = 0; index < tokens.words.size(); ++index) {
+		// Words after the first invalid one are never reached
+		const auto query_word = ParseQueryWord(tokens.words[index], index != tokens.first_invalid_word);
+		if (query_word.is_stop) {
+			continue;
+		}
+		const TermId term_id = index_.FindTerm(query_word.data);
+		if (term_id == NO_TERM) {
+			continue;
+		}
+		const size_t document_freq = index_.GetDocumentFreq(term_id);
+		if (document_freq == 0U) {
+			continue;
+		}
+		if (query_word.is_minus) {
+			result.minus_terms.push_back(term_id);
+		} else {
+			const double inverse_document_freq = champion_lists_.IsEnabled() ? champion_lists_.GetInverseDocumentFreq(term_id) : ComputeWordInverseDocumentFreq(document_freq);
+			result.plus_terms.push_back({term_id, index_.GetTerm(term_id), inverse_document_freq, document_freq});
+		}
+	}
+
+	sort(result.plus_terms.begin(), result.plus_terms.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.word < rhs.word;
+	});
+	result.plus_terms.erase(unique(result.plus_terms.begin(), result.plus_terms.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.term_id == rhs.term_id;
+	}), result.plus_terms.end());
+	sort(result.minus_terms.begin(), result.minus_terms.end());
+	result.minus_terms.erase(unique(result.minus_terms.begin(), result.minus_terms.end()), result.minus_terms.end());
+}
+
+SearchServer::QueryScratch& SearchServer::GetQueryScratch() {
+	thread_local QueryScratch scratch;
+
+	return scratch;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(size_t document_freq) const {
+	return log(GetDocumentCount() * 1.0 / document_freq);
+}
 
-	for (const string_view word : SplitIntoWords(text)) {
-		const auto query_word = ParseQueryWord(word);
-		if (!query_word.is_stop) {
-			if (query_word.is_minus) {
-				result.minus_words.insert(query_word.data);
-			} else {
-				result.plus_words.insert(query_word.data);
+vector<int64_t> SearchServer::SplitDocumentIds(const PreparedQuery& query) const {
+	const size_t thread_count = max(thread::hardware_concurrency(), 1U);
+	// A few ranges per thread smooth out uneven predicate and posting costs
+	return SplitDocumentIds(query, thread_count * 4U);
+}
+
+vector<int64_t> SearchServer::SplitDocumentIds(const PreparedQuery& query, size_t range_count) const {
+	// The longest posting list dominates the work and is a fair sample of the id distribution
+	TermId longest = NO_TERM;
+	for (const auto& term : query.plus_terms) {
+		if (longest == NO_TERM || index_.GetDocumentFreq(term.term_id) > index_.GetDocumentFreq(longest)) {
+			longest = term.term_id;
+		}
+	}
+
+	vector<int64_t> bounds = {INT64_MIN};
+	if (longest != NO_TERM && range_count > 1U) {
+		for (const int document_id : index_.SampleDocumentIds(longest, range_count)) {
+			if (document_id > bounds.back()) {
+				bounds.push_back(document_id);
 			}
 		}
 	}
+	bounds.push_back(INT64_MAX);
 
-	return result;
+	return bounds;
+}
+
+size_t SearchServer::GetPostingCount(const PreparedQuery& query) const {
+	size_t posting_count = 0;
+	for (const auto& term : query.plus_terms) {
+		posting_count += index_.GetDocumentFreq(term.term_id);
+	}
+
+	return posting_count;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+void SearchServer::FindRangeDocuments(const PreparedQuery& query, DocumentStatus status, const vector<int64_t>& bounds, size_t range_index, TopDocuments& top_documents) const {
+	CheckPreparedQuery(query);
+	const size_t expected_count = GetPostingCount(query) / (bounds.size() - 1U);
+	FindRangeDocuments(query, DocumentStatusFilter{status}, bounds, range_index, expected_count, top_documents);
+}
+
+void SearchServer::CheckPreparedQuery(const PreparedQuery& query) const {
+	if (query.server != this || query.generation != generation_) {
+		throw invalid_argument("Prepared query is outdated or belongs to another server"s);
+	}
 }
\ No newline at end of file
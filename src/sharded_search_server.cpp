@@ -0,0 +1,117 @@
+#include "../inc/sharded_search_server.h"
+
+using namespace std;
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count) {
+	if (shard_count == 0U) {
+		throw invalid_argument("Shard count must be positive"s);
+	}
+	shards_.reserve(shard_count);
+	for (size_t i = 0; i < shard_count; ++i) {
+		shards_.emplace_back(stop_words_text);
+	}
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+	// A repeated id maps to the same shard, which rejects it
+	GetShard(document_id).AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+	GetShard(document_id).RemoveDocument(document_id);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+	// The filter bypasses the shard result caches, which would miss changes of other shards
+	return FindTopDocuments(raw_query, DocumentStatusFilter{status});
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+	return GetShard(document_id).MatchDocument(raw_query, document_id);
+}
+
+void ShardedSearchServer::SetMaxResultDocumentCount(size_t max_result_document_count) {
+	max_result_document_count_ = max_result_document_count;
+	for (SearchServer& shard : shards_) {
+		shard.SetMaxResultDocumentCount(max_result_document_count);
+	}
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+	int document_count = 0;
+	for (const SearchServer& shard : shards_) {
+		document_count += shard.GetDocumentCount();
+	}
+
+	return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+	return shards_.size();
+}
+
+const SearchServer& ShardedSearchServer::GetShard(int document_id) const {
+	// Fibonacci hashing spreads consecutive ids evenly
+	const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9e3779b97f4a7c15ULL;
+
+	return shards_[(hash >> 32U) % shards_.size()];
+}
+
+SearchServer& ShardedSearchServer::GetShard(int document_id) {
+	return const_cast<SearchServer&>(static_cast<const ShardedSearchServer*>(this)->GetShard(document_id));
+}
+
+vector<PreparedQuery> ShardedSearchServer::PrepareQueries(string_view raw_query) const {
+	vector<PreparedQuery> queries(shards_.size());
+	for (size_t i = 0; i < shards_.size(); ++i) {
+		shards_[i].PrepareQuery(raw_query, queries[i]);
+	}
+
+	// Plus terms of every shard are sorted by word, so equal words are found by merging
+	vector<pair<string_view, size_t>> document_freqs;
+	for (const PreparedQuery& query : queries) {
+		for (const auto& term : query.plus_terms) {
+			document_freqs.emplace_back(term.word, term.document_freq);
+		}
+	}
+	sort(document_freqs.begin(), document_freqs.end());
+	size_t unique_count = 0;
+	for (size_t i = 0; i < document_freqs.size(); ++i) {
+		if (unique_count > 0U && document_freqs[unique_count - 1U].first == document_freqs[i].first) {
+			document_freqs[unique_count - 1U].second += document_freqs[i].second;
+		} else {
+			document_freqs[unique_count++] = document_freqs[i];
+		}
+	}
+	document_freqs.resize(unique_count);
+
+	// Same formula as SearchServer, so relevances are bit for bit those of one server
+	const int document_count = GetDocumentCount();
+	for (PreparedQuery& query : queries) {
+		auto document_freq = document_freqs.begin();
+		for (auto& term : query.plus_terms) {
+			document_freq = lower_bound(document_freq, document_freqs.end(), term.word, [](const pair<string_view, size_t>& entry, string_view word) {
+				return entry.first < word;
+			});
+			term.document_freq = document_freq->second;
+			term.inverse_document_freq = log(document_count * 1.0 / term.document_freq);
+		}
+	}
+
+	return queries;
+}
+
+vector<Document> ShardedSearchServer::MergeResults(const vector<vector<Document>>& shard_results) const {
+	TopDocuments top_documents(max_result_document_count_);
+	for (const vector<Document>& shard_result : shard_results) {
+		for (const Document& document : shard_result) {
+			top_documents.Add(document);
+		}
+	}
+
+	return top_documents.Extract();
+}
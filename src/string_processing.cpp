@@ -1,18 +1,152 @@
 #include "../inc/string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOKENIZER_USE_SSE2
+#endif
+
+#if defined(TOKENIZER_USE_SSE2) && defined(__GNUC__)
+#include <immintrin.h>
+#define TOKENIZER_USE_AVX2
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text) {
-	vector<string_view> words; 
-	while (true) {
-		const auto space = text.find(' ', 0);
-		words.push_back(text.substr(0, space));
-		if (space == text.npos) {
-			break;
-		} else {
-			text.remove_prefix(space + 1);
+namespace {
+
+// Bit i of a mask describes byte i of a 32-byte block
+struct BlockMasks {
+	uint32_t spaces;
+	uint32_t controls;
+};
+
+const size_t BLOCK_SIZE = 32;
+
+BlockMasks ClassifyBlockScalar(const char* data, size_t size) {
+	BlockMasks masks{0U, 0U};
+	for (size_t i = 0; i < size; ++i) {
+		const auto byte = static_cast<unsigned char>(data[i]);
+		masks.spaces |= static_cast<uint32_t>(byte == ' ') << i;
+		masks.controls |= static_cast<uint32_t>(byte < ' ') << i;
+	}
+
+	return masks;
+}
+
+#ifdef TOKENIZER_USE_SSE2
+BlockMasks ClassifyBlockSse2(const char* data, size_t) {
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i last_control = _mm_set1_epi8(' ' - 1);
+	const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+	// SSE2 has no unsigned comparison: a byte is a control character if min(byte, 31) == byte
+	const auto space_mask = [&spaces](__m128i bytes) {
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, spaces)));
+	};
+	const auto control_mask = [&last_control](__m128i bytes) {
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes)));
+	};
+
+	return {space_mask(low) | (space_mask(high) << 16U), control_mask(low) | (control_mask(high) << 16U)};
+}
+#endif
+
+#ifdef TOKENIZER_USE_AVX2
+__attribute__((target("avx2"))) BlockMasks ClassifyBlockAvx2(const char* data, size_t) {
+	const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+	const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+	const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8(' ' - 1)), bytes);
+
+	return {static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(controls))};
+}
+#endif
+
+using ClassifyBlock = BlockMasks (*)(const char* data, size_t size);
+
+ClassifyBlock ChooseClassifyBlock() {
+#ifdef TOKENIZER_USE_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		return ClassifyBlockAvx2;
+	}
+#endif
+#ifdef TOKENIZER_USE_SSE2
+	return ClassifyBlockSse2;
+#else
+	return ClassifyBlockScalar;
+#endif
+}
+
+int CountTrailingZeros(uint32_t mask) {
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
+	int count = 0;
+	for (; (mask & 1U) == 0U; mask >>= 1U) {
+		++count;
+	}
+	return count;
+#endif
+}
+
+} // namespace
+
+TokenizedText Tokenize(string_view text) {
+	TokenizedText result;
+	Tokenize(text, result);
+
+	return result;
+}
+
+void Tokenize(string_view text, TokenizedText& result) {
+	static const ClassifyBlock classify_full_block = ChooseClassifyBlock();
+
+	result.words.clear();
+	size_t first_control = text.size();
+	// Start of the current word, or npos between words
+	size_t word_begin = string_view::npos;
+	// The byte before the text counts as a space
+	uint32_t previous_space = 1U;
+	for (size_t block_begin = 0; block_begin < text.size(); block_begin += BLOCK_SIZE) {
+		const size_t block_size = min(BLOCK_SIZE, text.size() - block_begin);
+		BlockMasks masks = block_size == BLOCK_SIZE
+			? classify_full_block(text.data() + block_begin, block_size)
+			: ClassifyBlockScalar(text.data() + block_begin, block_size);
+		if (block_size < BLOCK_SIZE) {
+			// Bytes past the end act as spaces and close the last word
+			masks.spaces |= ~uint32_t{0} << block_size;
+		}
+		if (masks.controls != 0U && first_control == text.size()) {
+			first_control = block_begin + CountTrailingZeros(masks.controls);
+		}
+
+		// A set bit marks a byte whose kind differs from the byte before it: a word starts or ends there
+		uint32_t changes = masks.spaces ^ ((masks.spaces << 1U) | previous_space);
+		previous_space = masks.spaces >> (BLOCK_SIZE - 1U);
+		while (changes != 0U) {
+			const size_t position = block_begin + CountTrailingZeros(changes);
+			changes &= changes - 1U;
+			if (word_begin == string_view::npos) {
+				word_begin = position;
+			} else {
+				result.words.push_back(text.substr(word_begin, position - word_begin));
+				word_begin = string_view::npos;
+			}
 		}
 	}
+	if (word_begin != string_view::npos) {
+		result.words.push_back(text.substr(word_begin));
+	}
+
+	// Control characters are never spaces, so the first one lies inside a word
+	result.first_invalid_word = upper_bound(result.words.begin(), result.words.end(), text.data() + first_control,
+		[](const char* position, string_view word) {
+			return position < word.data() + word.size();
+		}) - result.words.begin();
+}
 
-	return words;
-}
\ No newline at end of file
+vector<string_view> SplitIntoWords(string_view text) {
+	return Tokenize(text).words;
+}
@@ -0,0 +1,254 @@
+#include "../inc/term_dictionary.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// Size of the heap block malloc hands out for a request: an 8-byte header, 16-byte granularity
+size_t EstimateHeapBlockSize(size_t size) {
+	return max<size_t>(32U, (size + 8U + 15U) / 16U * 16U);
+}
+
+} // namespace
+
+TermDictionary::TermDictionary(shared_ptr<const void> storage, const uint64_t* offsets, const char* text, TermId size)
+	: base_storage_(move(storage))
+	, base_offsets_(offsets)
+	, base_text_(text)
+	, base_size_(size) {
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+	: base_storage_(other.base_storage_)
+	, base_offsets_(other.base_offsets_)
+	, base_text_(other.base_text_)
+	, base_size_(other.base_size_)
+	, base_erased_(other.base_erased_)
+	, base_erased_count_(other.base_erased_count_)
+	, terms_(other.terms_)
+	, free_ids_(other.free_ids_)
+	, table_(other.table_)
+	, table_size_(other.table_size_) {
+	// Views must point into the own arena, not into the original one
+	RebuildArena();
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+	if (this != &other) {
+		*this = TermDictionary(other);
+	}
+
+	return *this;
+}
+
+TermId TermDictionary::Insert(string_view term) {
+	const uint64_t hash = CalculateHash(term);
+	if (!table_.empty()) {
+		const Slot& slot = table_[FindSlot(term, hash)];
+		if (slot.term_id != NO_TERM) {
+			return slot.term_id;
+		}
+	}
+	const TermId base_id = FindBase(term);
+	if (base_id != NO_TERM) {
+		if (IsBaseErased(base_id)) {
+			base_erased_[base_id] = false;
+			--base_erased_count_;
+		}
+
+		return base_id;
+	}
+
+	TermId term_id;
+	if (free_ids_.empty()) {
+		term_id = static_cast<TermId>(base_size_ + terms_.size());
+		terms_.push_back(arena_.Store(term));
+	} else {
+		term_id = free_ids_.back();
+		free_ids_.pop_back();
+		terms_[term_id - base_size_] = arena_.Store(term);
+	}
+	InsertSlot(term_id, hash);
+
+	return term_id;
+}
+
+void TermDictionary::Erase(TermId term_id) {
+	if (term_id < base_size_) {
+		if (base_erased_.empty()) {
+			base_erased_.resize(base_size_);
+		}
+		base_erased_[term_id] = true;
+		++base_erased_count_;
+		return;
+	}
+
+	string_view& term = terms_[term_id - base_size_];
+	EraseSlot(FindSlot(term, CalculateHash(term)));
+	arena_.Release(term);
+	term = {};
+	free_ids_.push_back(term_id);
+}
+
+TermId TermDictionary::Find(string_view term) const {
+	if (!table_.empty()) {
+		const Slot& slot = table_[FindSlot(term, CalculateHash(term))];
+		if (slot.term_id != NO_TERM) {
+			return slot.term_id;
+		}
+	}
+	const TermId base_id = FindBase(term);
+
+	return (base_id == NO_TERM || IsBaseErased(base_id)) ? NO_TERM : base_id;
+}
+
+string_view TermDictionary::GetTerm(TermId term_id) const {
+	if (term_id < base_size_) {
+		return {base_text_ + base_offsets_[term_id], base_offsets_[term_id + 1U] - base_offsets_[term_id]};
+	}
+
+	return terms_[term_id - base_size_];
+}
+
+bool TermDictionary::IsLive(TermId term_id) const {
+	if (term_id < base_size_) {
+		return !IsBaseErased(term_id);
+	}
+
+	return term_id < GetIdBound() && Find(GetTerm(term_id)) == term_id;
+}
+
+size_t TermDictionary::GetSize() const {
+	return base_size_ - base_erased_count_ + table_size_;
+}
+
+size_t TermDictionary::GetIdBound() const {
+	return base_size_ + terms_.size();
+}
+
+TermMemoryUsage TermDictionary::GetMemoryUsage() const {
+	TermMemoryUsage usage;
+	usage.term_count = table_size_;
+	usage.text_size = arena_.GetUsedSize();
+	usage.used_bytes = arena_.GetCapacity() + terms_.capacity() * sizeof(string_view)
+		+ table_.capacity() * sizeof(Slot) + free_ids_.capacity() * sizeof(TermId);
+
+	// A std::set node holds three pointers and the color next to the string; strings longer
+	// than the small string buffer own a heap block. The unordered_map node holds the next
+	// pointer, the key, the id and the cached hash, and every element has about one bucket.
+	const size_t set_node_size = EstimateHeapBlockSize(4U * sizeof(void*) + sizeof(string));
+	const size_t map_node_size = EstimateHeapBlockSize(sizeof(void*) + sizeof(pair<const string_view, TermId>) + sizeof(size_t)) + sizeof(void*);
+	const size_t small_string_capacity = string().capacity();
+	for (size_t index = 0; index < terms_.size(); ++index) {
+		const string_view term = terms_[index];
+		if (Find(term) != base_size_ + index) {
+			continue;
+		}
+		usage.node_layout_bytes += set_node_size + map_node_size;
+		if (term.size() > small_string_capacity) {
+			usage.node_layout_bytes += EstimateHeapBlockSize(term.size() + 1U);
+		}
+	}
+
+	return usage;
+}
+
+uint64_t TermDictionary::CalculateHash(string_view term) {
+	return hash<string_view>()(term);
+}
+
+size_t TermDictionary::FindSlot(string_view term, uint64_t hash) const {
+	const size_t mask = table_.size() - 1U;
+	for (size_t slot = hash & mask;; slot = (slot + 1U) & mask) {
+		const Slot& candidate = table_[slot];
+		if (candidate.term_id == NO_TERM
+			|| (candidate.hash == static_cast<uint32_t>(hash) && terms_[candidate.term_id - base_size_] == term)) {
+			return slot;
+		}
+	}
+}
+
+void TermDictionary::InsertSlot(TermId term_id, uint64_t hash) {
+	if ((table_size_ + 1U) * 4U > table_.size() * 3U) {
+		Rehash(max(MIN_TABLE_CAPACITY, table_.size() * 2U));
+	}
+	const size_t mask = table_.size() - 1U;
+	size_t slot = hash & mask;
+	while (table_[slot].term_id != NO_TERM) {
+		slot = (slot + 1U) & mask;
+	}
+	table_[slot] = {term_id, static_cast<uint32_t>(hash)};
+	++table_size_;
+}
+
+void TermDictionary::EraseSlot(size_t slot) {
+	// Shift later entries of the probe sequence back instead of leaving a tombstone
+	const size_t mask = table_.size() - 1U;
+	for (size_t next = (slot + 1U) & mask; table_[next].term_id != NO_TERM; next = (next + 1U) & mask) {
+		const size_t home = table_[next].hash & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			table_[slot] = table_[next];
+			slot = next;
+		}
+	}
+	table_[slot] = {};
+	--table_size_;
+}
+
+void TermDictionary::Rehash(size_t capacity) {
+	vector<Slot> old_table(capacity);
+	swap(table_, old_table);
+	const size_t mask = capacity - 1U;
+	for (const Slot& old_slot : old_table) {
+		if (old_slot.term_id == NO_TERM) {
+			continue;
+		}
+		// Only the low 32 bits of the hash are kept, enough to address any table of ids
+		size_t slot = old_slot.hash & mask;
+		while (table_[slot].term_id != NO_TERM) {
+			slot = (slot + 1U) & mask;
+		}
+		table_[slot] = old_slot;
+	}
+}
+
+TermId TermDictionary::FindBase(string_view term) const {
+	// Base terms are sorted, so a binary search over their ids finds the term
+	TermId first = 0;
+	TermId last = base_size_;
+	while (first < last) {
+		const TermId middle = first + (last - first) / 2U;
+		if (GetTerm(middle) < term) {
+			first = middle + 1U;
+		} else {
+			last = middle;
+		}
+	}
+
+	return (first < base_size_ && GetTerm(first) == term) ? first : NO_TERM;
+}
+
+bool TermDictionary::IsBaseErased(TermId term_id) const {
+	return !base_erased_.empty() && base_erased_[term_id];
+}
+
+void TermDictionary::RebuildArena() {
+	// Ids do not change, so the lookup table stays as it is
+	TextArena arena;
+	vector<bool> is_free(terms_.size());
+	for (const TermId term_id : free_ids_) {
+		is_free[term_id - base_size_] = true;
+	}
+	for (size_t index = 0; index < terms_.size(); ++index) {
+		if (!is_free[index]) {
+			terms_[index] = arena.Store(terms_[index]);
+		}
+	}
+	arena_ = move(arena);
+}
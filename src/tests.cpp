@@ -1,14 +1,102 @@
 #include "../inc/tests.h"
 #include "../inc/search_server.h"
 #include "../inc/remove_duplicates.h"
+#include "../inc/concurrent_search_server.h"
+#include "../inc/corpus_reader.h"
+#include "../inc/process_queries.h"
+#include "../inc/request_queue.h"
+#include "../inc/search_executor.h"
+#include "../inc/sharded_search_server.h"
+#include "../inc/text_arena.h"
 #include "../inc/assert.h"
 
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <execution>
+#include <filesystem>
+#include <future>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
+namespace {
+
+string GenerateText(mt19937& generator, int word_count) {
+	static const vector<string> dictionary = {
+		"cat"s, "dog"s, "bird"s, "fish"s, "white"s, "black"s, "curly"s, "nasty"s, "big"s, "small"s,
+		"tail"s, "eyes"s, "hat"s, "collar"s, "john"s, "pigeon"s, "rat"s, "pet"s, "funny"s, "hair"s,
+	};
+	uniform_int_distribution<size_t> word_index(0U, dictionary.size() - 1U);
+	string text;
+	for (int i = 0; i < word_count; ++i) {
+		if (i > 0) {
+			text += ' ';
+		}
+		text += dictionary[word_index(generator)];
+	}
+
+	return text;
+}
+
+struct GeneratedDocument {
+	int id;
+	string text;
+	DocumentStatus status;
+	vector<int> ratings;
+};
+
+vector<GeneratedDocument> GenerateDocuments(int document_count) {
+	mt19937 generator(42);
+	uniform_int_distribution<int> word_count(1, 12);
+	uniform_int_distribution<int> rating(-10, 10);
+	vector<GeneratedDocument> documents;
+	for (int id = 0; id < document_count; ++id) {
+		// Sparse ids exercise the id range splitting
+		GeneratedDocument& document = documents.emplace_back();
+		document.id = id * 7;
+		document.text = GenerateText(generator, word_count(generator));
+		document.status = static_cast<DocumentStatus>(id % 4);
+		document.ratings = {rating(generator), rating(generator)};
+	}
+
+	return documents;
+}
+
+SearchServer GenerateSearchServer(int document_count) {
+	SearchServer search_server("with and"s);
+	for (const GeneratedDocument& document : GenerateDocuments(document_count)) {
+		search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+	}
+
+	return search_server;
+}
+
+void AssertSameDocuments(const vector<Document>& lhs, const vector<Document>& rhs) {
+	ASSERT_EQUAL(lhs.size(), rhs.size());
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+		ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+		ASSERT(abs(lhs[i].relevance - rhs[i].relevance) < 1e-6);
+	}
+}
+
+const vector<string> GENERATED_QUERIES = {
+	"cat"s, "curly cat -dog"s, "nasty big rat -john -hair"s, "white black fish bird tail eyes hat"s,
+	"pet funny -cat -dog"s, "unknown words only"s, "-cat"s,
+};
+
+} // namespace
+
 void TestExcludeStopWordsFromAddedDocumentContent() {
 	const int doc_id = 42;
 	const string content = "cat in the city"s;
@@ -128,6 +216,40 @@ void TestComputeRelevance() {
 	ASSERT(abs(doc2.relevance - 0.101366) < 1e-6);
 }
 
+void TestMaxResultDocumentCount() {
+	SearchServer search_server(""s);
+	for (int id = 0; id < 10; ++id) {
+		search_server.AddDocument(id, "cat "s + string(id, 'x'), DocumentStatus::ACTUAL, {id});
+	}
+	ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+	search_server.SetMaxResultDocumentCount(20U);
+	const auto all_docs = search_server.FindTopDocuments("cat"s);
+	ASSERT_EQUAL(all_docs.size(), 10U);
+
+	search_server.SetMaxResultDocumentCount(3U);
+	for (const auto& found_docs : {search_server.FindTopDocuments("cat"s), search_server.FindTopDocuments(execution::par, "cat"s)}) {
+		ASSERT_EQUAL(found_docs.size(), 3U);
+		for (size_t i = 0; i < found_docs.size(); ++i) {
+			ASSERT_EQUAL_HINT(found_docs[i].id, all_docs[i].id, "Limited result must be a prefix of the full ranking"s);
+		}
+	}
+
+	search_server.SetMaxResultDocumentCount(0U);
+	ASSERT(search_server.FindTopDocuments("cat"s).empty());
+}
+
+void TestParallelSearchMatchesSequential() {
+	SearchServer search_server = GenerateSearchServer(2000);
+	search_server.SetMaxResultDocumentCount(50U);
+	for (const string& query : GENERATED_QUERIES) {
+		AssertSameDocuments(search_server.FindTopDocuments(execution::par, query), search_server.FindTopDocuments(execution::seq, query));
+		AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), search_server.FindTopDocuments(query, DocumentStatus::BANNED));
+		const auto even_rating = [](int document_id, DocumentStatus status, int rating) { return rating % 2 == 0; };
+		AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, even_rating), search_server.FindTopDocuments(query, even_rating));
+	}
+}
+
 void TestMatchDocuments() {
 	SearchServer search_server(""s);
 	search_server.AddDocument(42, "белый кот и модный ошейник"s, DocumentStatus::BANNED, {1, 2, 3});
@@ -146,6 +268,241 @@ void TestMatchDocuments() {
 	}
 }
 
+void TestPreparedQuery() {
+	SearchServer search_server("и"s);
+	search_server.AddDocument(42, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {1, 2, 3});
+	search_server.AddDocument(48, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {4, 5, 6});
+	search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {-1, 12, -6});
+
+	const string raw_query = "пушистый и ухоженный кот кот -ошейник -слон"s;
+	const PreparedQuery query = search_server.PrepareQuery(raw_query);
+	ASSERT_EQUAL_HINT(query.plus_terms.size(), 3U, "Stop words, duplicates and unknown words must be dropped"s);
+	ASSERT_EQUAL(query.minus_terms.size(), 1U);
+
+	const auto expected = search_server.FindTopDocuments(raw_query);
+	const auto found_docs = search_server.FindTopDocuments(query);
+	ASSERT_EQUAL(found_docs.size(), expected.size());
+	for (size_t i = 0; i < found_docs.size(); ++i) {
+		ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+		ASSERT(abs(found_docs[i].relevance - expected[i].relevance) < 1e-6);
+	}
+	ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, query).size(), expected.size());
+
+	for (const int document_id : search_server) {
+		const auto [words, status] = search_server.MatchDocument(query, document_id);
+		const auto [par_words, par_status] = search_server.MatchDocument(execution::par, query, document_id);
+		ASSERT_EQUAL(words, get<0>(search_server.MatchDocument(raw_query, document_id)));
+		ASSERT_EQUAL(words, par_words);
+	}
+	ASSERT(get<0>(search_server.MatchDocument(query, 42)).empty());
+
+	search_server.AddDocument(3, "кот"s, DocumentStatus::ACTUAL, {1});
+	bool outdated = false;
+	try {
+		search_server.FindTopDocuments(query);
+	} catch (const invalid_argument&) {
+		outdated = true;
+	}
+	ASSERT_HINT(outdated, "Prepared query must be rejected after the index changes"s);
+}
+
+void TestAddDocuments() {
+	const SearchServer expected = GenerateSearchServer(500);
+
+	const vector<GeneratedDocument> generated = GenerateDocuments(500);
+	vector<RawDocument> documents;
+	for (const GeneratedDocument& document : generated) {
+		documents.push_back({document.id, document.text, document.status, document.ratings});
+	}
+	// Descending ids make every merge insert in front of existing postings
+	reverse(documents.begin(), documents.end());
+
+	SearchServer search_server("with and"s);
+	search_server.AddDocuments(execution::par, vector<RawDocument>(documents.begin(), documents.begin() + 250));
+	search_server.AddDocuments(vector<RawDocument>(documents.begin() + 250, documents.end()));
+	ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+	for (const string& query : GENERATED_QUERIES) {
+		AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query));
+		AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::REMOVED), expected.FindTopDocuments(query, DocumentStatus::REMOVED));
+	}
+	ASSERT_EQUAL(search_server.GetWordFrequencies(7), expected.GetWordFrequencies(7));
+
+	const auto is_rejected = [&search_server](const vector<RawDocument>& batch) {
+		try {
+			search_server.AddDocuments(execution::par, batch);
+		} catch (const invalid_argument&) {
+			return true;
+		}
+		return false;
+	};
+	ASSERT_HINT(is_rejected({{10000, "cat"sv, DocumentStatus::ACTUAL, {}}, {10000, "dog"sv, DocumentStatus::ACTUAL, {}}}), "Duplicate ids inside a batch must be rejected"s);
+	ASSERT_HINT(is_rejected({{10000, "cat"sv, DocumentStatus::ACTUAL, {}}, {0, "dog"sv, DocumentStatus::ACTUAL, {}}}), "Existing ids must be rejected"s);
+	ASSERT_HINT(is_rejected({{10000, "cat"sv, DocumentStatus::ACTUAL, {}}, {10001, "d\x12og"sv, DocumentStatus::ACTUAL, {}}}), "Invalid words must be rejected"s);
+	ASSERT_HINT(search_server.FindTopDocuments("-cat dog"s).size() == expected.FindTopDocuments("-cat dog"s).size(), "Rejected batch must not be added partially"s);
+	ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+
+	// Thousands of terms are merged and removed concurrently; the mutable segment must keep
+	// counting all of their postings, or sequential searches skip it
+	{
+		vector<string> texts;
+		for (int id = 0; id < 4000; ++id) {
+			texts.push_back("word"s + to_string(id) + " term"s + to_string(id % 1000));
+		}
+		vector<RawDocument> batch;
+		for (int id = 0; id < 4000; ++id) {
+			batch.push_back({id, texts[id], DocumentStatus::ACTUAL, {1}});
+		}
+		SearchServer parallel_server("with and"s);
+		parallel_server.SetSegmentPolicy({1U << 20U, 4U, false});
+		parallel_server.AddDocuments(execution::par, batch);
+		for (int id = 0; id < 4000; id += 2) {
+			parallel_server.RemoveDocument(execution::par, id);
+		}
+		for (int id = 0; id < 4000; ++id) {
+			const vector<Document> found = parallel_server.FindTopDocuments(execution::seq, "word"s + to_string(id));
+			ASSERT_EQUAL(found.size(), id % 2 == 0 ? 0U : 1U);
+		}
+		ASSERT_EQUAL(parallel_server.FindTopDocuments(execution::seq, "term1"s).size(), 4U);
+		parallel_server.FlushIndex();
+		ASSERT_EQUAL(parallel_server.FindTopDocuments(execution::seq, "word3999"s).size(), 1U);
+	}
+}
+
+void TestSegmentedIndex() {
+	const vector<GeneratedDocument> documents = GenerateDocuments(600);
+	for (const bool background_merges : {false, true}) {
+		SearchServer expected("with and"s);
+		SearchServer search_server("with and"s);
+		search_server.SetSegmentPolicy({64U, 2U, background_merges});
+		for (const GeneratedDocument& document : documents) {
+			expected.AddDocument(document.id, document.text, document.status, document.ratings);
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		ASSERT_HINT(search_server.GetSegmentCount() > 1U, "Documents must be spread over several segments"s);
+
+		// Deletions hit sealed segments, some of which are being merged right now
+		for (const GeneratedDocument& document : documents) {
+			if (document.id % 3 == 0) {
+				expected.RemoveDocument(document.id);
+				search_server.RemoveDocument(document.id);
+			}
+		}
+		for (const GeneratedDocument& document : documents) {
+			if (document.id % 9 == 0) {
+				expected.AddDocument(document.id, "curly cat"s, document.status, document.ratings);
+				search_server.AddDocument(document.id, "curly cat"s, document.status, document.ratings);
+			}
+		}
+
+		for (int round = 0; round < 2; ++round) {
+			expected.SetMaxResultDocumentCount(30U);
+			search_server.SetMaxResultDocumentCount(30U);
+			for (const string& query : GENERATED_QUERIES) {
+				AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query));
+				AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), expected.FindTopDocuments(query, DocumentStatus::BANNED));
+			}
+			for (const int document_id : {0, 7, 9 * 7, 600 * 7 - 7}) {
+				ASSERT_EQUAL(get<0>(search_server.MatchDocument("curly cat dog -hat"s, document_id)), get<0>(expected.MatchDocument("curly cat dog -hat"s, document_id)));
+			}
+			search_server.FlushIndex();
+			search_server.WaitForIndexMerges();
+		}
+		ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+	}
+}
+
+void TestSnapshotIsolation() {
+	{
+		SearchServer original("and"s);
+		original.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, {1});
+		original.AddDocument(2, "nasty dog"s, DocumentStatus::ACTUAL, {2});
+		original.FlushIndex();
+		original.AddDocument(3, "curly dog"s, DocumentStatus::ACTUAL, {3});
+		const SearchServer copy(original);
+		original.RemoveDocument(3);
+		original.RemoveDocument(1);
+		ASSERT_HINT(copy.FindTopDocuments("curly"s).size() == 2U, "Copies must not see later changes of the original"s);
+		ASSERT_EQUAL(get<0>(copy.MatchDocument("curly dog"s, 3)).size(), 2U);
+		ASSERT_EQUAL(copy.GetWordFrequencies(1).at("cat"sv), 0.5);
+		ASSERT_EQUAL(original.FindTopDocuments("curly"s).size(), 0U);
+	}
+
+	const vector<GeneratedDocument> documents = GenerateDocuments(400);
+	SearchServer initial("with and"s);
+	initial.SetSegmentPolicy({32U, 2U, true});
+	ConcurrentSearchServer search_server(move(initial), 8U);
+
+	atomic_bool done = false;
+	atomic_int failures = 0;
+	vector<thread> readers;
+	for (int i = 0; i < 3; ++i) {
+		readers.emplace_back([&search_server, &done, &failures]() {
+			int last_count = 0;
+			while (!done) {
+				const auto snapshot = search_server.GetSnapshot();
+				const auto first = snapshot->FindTopDocuments("curly cat -dog"s);
+				const auto second = snapshot->FindTopDocuments(execution::par, "curly cat -dog"s);
+				const bool same = first.size() == second.size() && equal(first.begin(), first.end(), second.begin(), [](const Document& lhs, const Document& rhs) {
+					return lhs.id == rhs.id;
+				});
+				if (!same || snapshot->GetDocumentCount() < last_count) {
+					++failures;
+				}
+				last_count = snapshot->GetDocumentCount();
+			}
+		});
+	}
+	for (const GeneratedDocument& document : documents) {
+		search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		if (document.id % 5 == 0) {
+			search_server.RemoveDocument(document.id);
+		}
+	}
+	search_server.Publish();
+	done = true;
+	for (thread& reader : readers) {
+		reader.join();
+	}
+
+	ASSERT_EQUAL_HINT(failures.load(), 0, "A pinned snapshot must not change"s);
+	ASSERT_EQUAL(search_server.GetDocumentCount(), 320);
+
+	// By default the number of writes between publishes grows with the corpus
+	ConcurrentSearchServer adaptive(GenerateSearchServer(640), ConcurrentSearchServer::ADAPTIVE_PUBLISH_INTERVAL, ConcurrentSearchServer::Clock::duration::max());
+	for (int i = 0; i < 9; ++i) {
+		adaptive.AddDocument(100000 + i, "curly cat"s, DocumentStatus::ACTUAL, {1});
+	}
+	ASSERT_EQUAL(adaptive.GetDocumentCount(), 640);
+	adaptive.RemoveDocument(0);
+	ASSERT_EQUAL(adaptive.GetDocumentCount(), 648);
+	// A batch counts all of its documents
+	vector<RawDocument> batch;
+	for (int i = 0; i < 10; ++i) {
+		batch.push_back({200000 + i, "curly dog"sv, DocumentStatus::ACTUAL, {2}});
+	}
+	adaptive.AddDocuments(execution::seq, batch);
+	ASSERT_EQUAL(adaptive.GetDocumentCount(), 658);
+
+	// Writes too few to reach the interval are published once they are max_staleness old
+	ConcurrentSearchServer bounded(GenerateSearchServer(640), ConcurrentSearchServer::ADAPTIVE_PUBLISH_INTERVAL, chrono::milliseconds(10));
+	const auto wait_for = [](const auto& condition) {
+		const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+		while (!condition() && chrono::steady_clock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return condition();
+	};
+	bounded.AddDocument(100000, "curly parrot"s, DocumentStatus::ACTUAL, {1});
+	ASSERT_HINT(wait_for([&bounded]() {
+		return bounded.FindTopDocuments("parrot"s).size() == 1U;
+	}), "An added document must become visible within the staleness bound"s);
+	bounded.RemoveDocument(100000);
+	ASSERT_HINT(wait_for([&bounded]() {
+		return bounded.FindTopDocuments("parrot"s).empty();
+	}), "A removed document must disappear within the staleness bound"s);
+	ASSERT_EQUAL(bounded.GetDocumentCount(), 640);
+}
+
 void TestRemoveDuplicates() {
 	SearchServer search_server("and with"s);
     search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
@@ -178,6 +535,979 @@ void TestRemoveDocument() {
 	ASSERT(search_server.GetDocumentCount() == 2);
 }
 
+void TestRemovedDocumentNotFound() {
+	SearchServer search_server(""s);
+	search_server.AddDocument(42, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {1, 2, 3});
+	search_server.AddDocument(48, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {4, 5, 6});
+	search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {-1, 12, -6});
+	search_server.RemoveDocument(48);
+
+	const auto found_docs = search_server.FindTopDocuments("пушистый кот"s);
+	ASSERT_EQUAL(found_docs.size(), 1U);
+	ASSERT_EQUAL(found_docs[0].id, 42);
+	ASSERT_HINT(search_server.FindTopDocuments("хвост"s).empty(), "Removed document must not be found"s);
+	ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, "пушистый кот"s).size(), 1U);
+
+	search_server.AddDocument(48, "пушистый хвост"s, DocumentStatus::ACTUAL, {4, 5, 6});
+	const auto [words, status] = search_server.MatchDocument("пушистый кот хвост"s, 48);
+	ASSERT_EQUAL(words.size(), 2U);
+}
+
+void TestCompactInternalIds() {
+	const vector<GeneratedDocument> documents = GenerateDocuments(3000);
+	for (const size_t champion_count : {size_t{0}, size_t{8}}) {
+		SearchServer search_server("with and"s);
+		search_server.SetSegmentPolicy({512U, 4U, false});
+		search_server.SetChampionListSize(champion_count);
+		for (const GeneratedDocument& document : documents) {
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		const PreparedQuery prepared_query = search_server.PrepareQuery("curly cat"s);
+		// Removing most documents renumbers the rest; a removed id comes back as a new document
+		for (size_t i = 0; i < documents.size(); ++i) {
+			if (i % 4U != 0U) {
+				search_server.RemoveDocument(documents[i].id);
+			}
+		}
+		search_server.AddDocument(documents[1].id, "curly cat with hat"s, DocumentStatus::ACTUAL, {4});
+		// Renumbering seals all live postings into one segment
+		ASSERT_EQUAL(search_server.GetSegmentCount(), 1U);
+
+		SearchServer expected("with and"s);
+		for (size_t i = 0; i < documents.size(); i += 4U) {
+			expected.AddDocument(documents[i].id, documents[i].text, documents[i].status, documents[i].ratings);
+		}
+		expected.AddDocument(documents[1].id, "curly cat with hat"s, DocumentStatus::ACTUAL, {4});
+
+		ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+		ASSERT(equal(search_server.begin(), search_server.end(), expected.begin(), expected.end()));
+		for (const string& query : GENERATED_QUERIES) {
+			AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query));
+			AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), expected.FindTopDocuments(query, DocumentStatus::BANNED));
+		}
+		for (size_t i = 0; i < documents.size(); i += 40U) {
+			ASSERT(search_server.MatchDocument("curly cat -dog"s, documents[i].id) == expected.MatchDocument("curly cat -dog"s, documents[i].id));
+			ASSERT(search_server.GetWordFrequencies(documents[i].id) == expected.GetWordFrequencies(documents[i].id));
+		}
+		try {
+			search_server.FindTopDocuments(prepared_query);
+			ASSERT_HINT(false, "Renumbering must outdate prepared queries"s);
+		} catch (const invalid_argument&) {
+		}
+	}
+}
+
+void TestRemoveDocumentReclaimsTerms() {
+	{
+		InvertedIndex index;
+		const TermId cat = index.AddTerm("cat"sv);
+		const TermId dog = index.AddTerm("dog"sv);
+		index.AddPosting(cat, 1, 0.5);
+		index.AddPosting(dog, 1, 0.5);
+		index.RemovePosting(cat, 1);
+		index.RemoveTerm(cat);
+		ASSERT_EQUAL(index.GetTermCount(), 1U);
+		ASSERT_EQUAL(index.FindTerm("cat"sv), NO_TERM);
+		ASSERT_EQUAL_HINT(index.AddTerm("bird"sv), cat, "Ids of removed terms must be reused"s);
+		ASSERT_EQUAL(index.GetTerm(dog), "dog"sv);
+		ASSERT_EQUAL(index.GetDocumentFreq(cat), 0U);
+	}
+	{
+		SearchServer search_server(""s);
+		search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {1});
+		search_server.AddDocument(2, "curly dog"s, DocumentStatus::ACTUAL, {2});
+		search_server.RemoveDocument(execution::par, 1);
+		search_server.RemoveDocument(3);
+		ASSERT_EQUAL(search_server.GetDocumentCount(), 1);
+		ASSERT(search_server.FindTopDocuments("cat tail"s).empty());
+
+		// Hourly delete/re-add cycles must keep working on recycled term ids
+		for (int cycle = 0; cycle < 3; ++cycle) {
+			search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+			ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1U);
+			const auto [words, status] = search_server.MatchDocument("white cat dog"s, 1);
+			ASSERT_EQUAL(words.size(), 2U);
+			search_server.RemoveDocument(1);
+		}
+		ASSERT_EQUAL(search_server.FindTopDocuments("curly dog"s).size(), 1U);
+	}
+}
+
+void TestBlockMaxWand() {
+	const vector<GeneratedDocument> documents = GenerateDocuments(5000);
+	const auto even_rating = [](int document_id, DocumentStatus status, int rating) {
+		return rating % 2 == 0;
+	};
+	// The parallel search scores every posting, so it serves as the exhaustive reference
+	for (const size_t posting_limit : {size_t{1} << 20U, size_t{300}}) {
+		SearchServer search_server("with and"s);
+		search_server.SetSegmentPolicy({posting_limit, 4U, false});
+		for (const GeneratedDocument& document : documents) {
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		for (const GeneratedDocument& document : documents) {
+			if (document.id % 5 == 0) {
+				search_server.RemoveDocument(document.id);
+			}
+		}
+
+		for (const size_t limit : {1U, 5U, 100U}) {
+			search_server.SetMaxResultDocumentCount(limit);
+			for (const string& query : GENERATED_QUERIES) {
+				AssertSameDocuments(search_server.FindTopDocuments(query), search_server.FindTopDocuments(execution::par, query));
+				AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::BANNED), search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED));
+				AssertSameDocuments(search_server.FindTopDocuments(query, even_rating), search_server.FindTopDocuments(execution::par, query, even_rating));
+			}
+		}
+	}
+
+	// A word of every document weighs nothing, so ratings and ids decide among equal scores
+	SearchServer search_server(""s);
+	for (int id = 0; id < 300; ++id) {
+		search_server.AddDocument(id, id % 3 == 0 ? "common rare"s : "common"s, DocumentStatus::ACTUAL, {id % 11});
+	}
+	search_server.SetMaxResultDocumentCount(10U);
+	for (const string& query : {"common"s, "common rare"s, "common -rare"s}) {
+		AssertSameDocuments(search_server.FindTopDocuments(query), search_server.FindTopDocuments(execution::par, query));
+	}
+	search_server.SetMaxResultDocumentCount(0U);
+	ASSERT(search_server.FindTopDocuments("common rare"s).empty());
+}
+
+void TestChampionLists() {
+	const vector<GeneratedDocument> documents = GenerateDocuments(3000);
+	const auto even_rating = [](int document_id, DocumentStatus status, int rating) {
+		return rating % 2 == 0;
+	};
+	for (const size_t champion_count : {1U, 4U, 32U}) {
+		SearchServer expected("with and"s);
+		SearchServer search_server("with and"s);
+		// Half of the documents arrive before the lists are built, half are added to them
+		for (size_t i = 0; i < documents.size(); ++i) {
+			const GeneratedDocument& document = documents[i];
+			expected.AddDocument(document.id, document.text, document.status, document.ratings);
+			if (i == documents.size() / 2U) {
+				search_server.SetChampionListSize(champion_count);
+			}
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		for (const GeneratedDocument& document : documents) {
+			if (document.id % 3 == 0) {
+				expected.RemoveDocument(document.id);
+				search_server.RemoveDocument(document.id);
+			}
+		}
+		const vector<RawDocument> batch = {{1, "curly cat"sv, DocumentStatus::ACTUAL, {9}}, {4, "cat"sv, DocumentStatus::ACTUAL, {1}}};
+		expected.AddDocuments(batch);
+		search_server.AddDocuments(batch);
+
+		for (const size_t limit : {1U, 5U, 50U}) {
+			expected.SetMaxResultDocumentCount(limit);
+			search_server.SetMaxResultDocumentCount(limit);
+			for (const string& query : GENERATED_QUERIES) {
+				AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query));
+				AssertSameDocuments(search_server.FindTopDocuments(query, even_rating), expected.FindTopDocuments(query, even_rating));
+				AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), expected.FindTopDocuments(query, DocumentStatus::BANNED));
+			}
+		}
+	}
+
+	// A few documents dominate the term, so their lists alone settle the query
+	SearchServer search_server(""s);
+	for (int id = 0; id < 1000; ++id) {
+		search_server.AddDocument(id, id % 100 == 0 ? "common"s : id % 10 == 0 ? "other words"s : "common a b c d e f g"s, DocumentStatus::ACTUAL, {1});
+	}
+	search_server.SetChampionListSize(16U);
+	search_server.SetMaxResultDocumentCount(5U);
+	size_t predicate_calls = 0;
+	const vector<Document> found = search_server.FindTopDocuments("common"s, [&predicate_calls](int document_id, DocumentStatus status, int rating) {
+		++predicate_calls;
+		return true;
+	});
+	ASSERT_EQUAL(found.size(), 5U);
+	ASSERT_EQUAL(found[0].id, 0);
+	ASSERT(predicate_calls <= 16U);
+}
+
+void TestDocumentAttributes() {
+	DocumentAttributes attributes;
+	const int document_count = 200;
+	for (int id = 0; id < document_count; ++id) {
+		attributes.Add(id, id - 3, static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT));
+	}
+	ASSERT_EQUAL(attributes.GetSize(), static_cast<size_t>(document_count));
+	for (int id = 0; id < document_count; ++id) {
+		ASSERT_EQUAL(attributes.GetRating(id), id - 3);
+		ASSERT(attributes.GetStatus(id) == static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT));
+		for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+			ASSERT_EQUAL(attributes.HasStatus(id, static_cast<DocumentStatus>(status)), status == id % DOCUMENT_STATUS_COUNT);
+		}
+	}
+	attributes.Remove(64);
+	ASSERT_EQUAL(attributes.GetSize(), static_cast<size_t>(document_count - 1));
+	for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+		ASSERT(!attributes.HasStatus(64, static_cast<DocumentStatus>(status)));
+	}
+	ASSERT(attributes.HasStatus(63, DocumentStatus::REMOVED) && attributes.HasStatus(65, DocumentStatus::IRRELEVANT));
+
+	// Status filters take the bitmap path and agree with an equivalent lambda
+	SearchServer search_server = GenerateSearchServer(2000);
+	for (const size_t status : {0U, 1U, 2U, 3U}) {
+		const auto status_lambda = [status](int document_id, DocumentStatus document_status, int rating) {
+			return document_status == static_cast<DocumentStatus>(status);
+		};
+		for (const string& query : GENERATED_QUERIES) {
+			AssertSameDocuments(search_server.FindTopDocuments(query, static_cast<DocumentStatus>(status)), search_server.FindTopDocuments(query, status_lambda));
+			AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, static_cast<DocumentStatus>(status)), search_server.FindTopDocuments(query, status_lambda));
+		}
+	}
+	try {
+		search_server.MatchDocument("cat"s, 1);
+		ASSERT_HINT(false, "Unknown document ids must be rejected"s);
+	} catch (const out_of_range&) {
+	}
+}
+
+void TestInternalDocumentIds() {
+	SearchServer search_server("and"s);
+	// Sparse ids arriving out of order; equal texts and ratings leave the id to break ties
+	const vector<int> ids = {INT_MAX, 10, 1'000'000'000, 5, 0};
+	for (const int id : ids) {
+		search_server.AddDocument(id, "white cat"s, DocumentStatus::ACTUAL, {1});
+	}
+	search_server.AddDocument(77, "black dog"s, DocumentStatus::BANNED, {2});
+	ASSERT_EQUAL(vector<int>(search_server.begin(), search_server.end()), (vector<int>{0, 5, 10, 77, 1'000'000'000, INT_MAX}));
+
+	const auto found_ids = [](const vector<Document>& documents) {
+		vector<int> result;
+		for (const Document& document : documents) {
+			result.push_back(document.id);
+		}
+		return result;
+	};
+	ASSERT_EQUAL(found_ids(search_server.FindTopDocuments("cat"s)), (vector<int>{0, 5, 10, 1'000'000'000, INT_MAX}));
+	ASSERT_EQUAL(found_ids(search_server.FindTopDocuments(execution::par, "cat"s)), (vector<int>{0, 5, 10, 1'000'000'000, INT_MAX}));
+	ASSERT_EQUAL(found_ids(search_server.FindTopDocuments("dog"s, DocumentStatus::BANNED)), vector<int>{77});
+	ASSERT_EQUAL(found_ids(search_server.FindTopDocuments("cat"s, [](int document_id, DocumentStatus status, int rating) {
+		return document_id > 10;
+	})), (vector<int>{1'000'000'000, INT_MAX}));
+	ASSERT_EQUAL(get<0>(search_server.MatchDocument("cat dog"s, INT_MAX)), vector<string_view>{"cat"sv});
+	ASSERT_EQUAL(search_server.GetWordFrequencies(77).count("dog"sv), 1U);
+
+	// A removed id can come back and is a new document
+	search_server.RemoveDocument(10);
+	search_server.AddDocument(10, "black cat"s, DocumentStatus::ACTUAL, {5});
+	ASSERT_EQUAL(found_ids(search_server.FindTopDocuments("black cat"s)).front(), 10);
+	ASSERT(get<1>(search_server.MatchDocument("cat"s, 10)) == DocumentStatus::ACTUAL);
+
+	const string path = (filesystem::temp_directory_path() / "search_engine_internal_ids.index"s).string();
+	search_server.Save(path);
+	const SearchServer loaded = SearchServer::Load(path);
+	filesystem::remove(path);
+	ASSERT_EQUAL(vector<int>(loaded.begin(), loaded.end()), vector<int>(search_server.begin(), search_server.end()));
+	for (const string& query : {"cat"s, "black cat"s, "white -black"s}) {
+		AssertSameDocuments(loaded.FindTopDocuments(query), search_server.FindTopDocuments(query));
+	}
+	ASSERT_EQUAL(get<0>(loaded.MatchDocument("black dog"s, 77)), (vector<string_view>{"black"sv, "dog"sv}));
+}
+
+void TestCompressedPostings() {
+	mt19937 generator(7);
+	vector<PostingList> rows;
+	for (const size_t size : {0U, 1U, 127U, 128U, 129U, 1000U}) {
+		PostingList row;
+		int document_id = 0;
+		for (size_t i = 0; i < size; ++i) {
+			// Runs of consecutive ids pack into zero-width gaps, the rest need up to 20 bits
+			document_id += (i / 100U) % 2U == 0U ? 1 : 1 + static_cast<int>(generator() % (1U << 20U));
+			row.push_back({document_id, static_cast<double>(generator() % (i < 500U ? 3U : 200U)) / 7.0});
+		}
+		rows.push_back(move(row));
+	}
+	rows.push_back({{0, 0.5}, {INT_MAX / 2, 0.25}, {INT_MAX - 1, 1.0}});
+
+	const ImmutableSegment segment(rows);
+	ASSERT(segment.IsConsistent());
+	ASSERT_EQUAL(segment.GetTermBound(), rows.size());
+	ASSERT_EQUAL(segment.GetPostingCount(static_cast<TermId>(rows.size())), 0U);
+	size_t posting_count = 0;
+	for (TermId term_id = 0; term_id < rows.size(); ++term_id) {
+		const PostingList& row = rows[term_id];
+		ASSERT_EQUAL(segment.GetPostingCount(term_id), row.size());
+		posting_count += row.size();
+
+		PostingList decoded;
+		segment.ForEachPosting(term_id, INT64_MIN, INT64_MAX, [&decoded](const Posting& posting) {
+			decoded.push_back(posting);
+		});
+		ASSERT_EQUAL(decoded.size(), row.size());
+		for (size_t i = 0; i < row.size(); ++i) {
+			ASSERT_EQUAL(decoded[i].document_id, row[i].document_id);
+			ASSERT_EQUAL(decoded[i].term_freq, row[i].term_freq);
+			ASSERT(segment.HasPosting(term_id, row[i].document_id));
+			ASSERT(segment.HasDocument(row[i].document_id));
+		}
+		if (row.size() > 2U) {
+			const int first = row[1].document_id;
+			const int last = row[row.size() - 1U].document_id;
+			size_t sliced_count = 0;
+			segment.ForEachPosting(term_id, first, last, [&sliced_count, first, last](const Posting& posting) {
+				ASSERT(posting.document_id >= first && posting.document_id < last);
+				++sliced_count;
+			});
+			ASSERT_EQUAL(sliced_count, row.size() - 2U);
+		}
+		for (const Posting& posting : row) {
+			if (!binary_search(row.begin(), row.end(), Posting{posting.document_id + 1, 0.0}, [](const Posting& lhs, const Posting& rhs) {
+				return lhs.document_id < rhs.document_id;
+			})) {
+				ASSERT(!segment.HasPosting(term_id, posting.document_id + 1));
+			}
+		}
+		ASSERT(!segment.HasPosting(term_id, -1));
+	}
+	ASSERT_EQUAL(segment.GetPostingCount(), posting_count);
+	// Even 20-bit gaps pack into a fraction of the 16 bytes of a plain Posting
+	ASSERT(segment.GetLayout().packed_data.size() * sizeof(uint64_t) < posting_count * sizeof(Posting) / 2U);
+
+	// Merging keeps live postings of both inputs in document id order
+	const int deleted_id = rows[5][0].document_id;
+	size_t deleted_count = 0;
+	for (const PostingList& row : rows) {
+		deleted_count += count_if(row.begin(), row.end(), [deleted_id](const Posting& posting) {
+			return posting.document_id == deleted_id;
+		});
+	}
+	const auto shared_segment = make_shared<const ImmutableSegment>(rows);
+	const ImmutableSegment merged(vector<ImmutableSegment::MergeInput>{{shared_segment, {deleted_id}}, {make_shared<const ImmutableSegment>(vector<PostingList>{{{-5, 2.0}}}), {}}});
+	ASSERT(merged.IsConsistent());
+	ASSERT_EQUAL(merged.GetPostingCount(), posting_count - deleted_count + 1U);
+	ASSERT(merged.HasPosting(0, -5));
+	ASSERT(!merged.HasPosting(5, deleted_id));
+	ASSERT(merged.HasPosting(5, rows[5][1].document_id));
+}
+
+void TestIndexFile() {
+	const string path = (filesystem::temp_directory_path() / "search_engine_test.index"s).string();
+	{
+		SearchServer original = GenerateSearchServer(500);
+		original.SetSegmentPolicy({256U, 4U, false});
+		original.FlushIndex();
+		// Sealed segments with deletions, the mutable segment and a removed term all go to the file
+		original.RemoveDocument(7);
+		original.RemoveDocument(14);
+		original.AddDocument(5000, "curly unique hedgehog with hat"s, DocumentStatus::ACTUAL, {3});
+		original.AddDocument(5001, "lonely wombat"s, DocumentStatus::ACTUAL, {1});
+		original.RemoveDocument(5001);
+		original.Save(path);
+
+		SearchServer loaded = SearchServer::Load(path);
+		ASSERT_EQUAL(loaded.GetDocumentCount(), original.GetDocumentCount());
+		ASSERT(equal(loaded.begin(), loaded.end(), original.begin(), original.end()));
+		for (const string& query : GENERATED_QUERIES) {
+			AssertSameDocuments(loaded.FindTopDocuments(query), original.FindTopDocuments(query));
+			AssertSameDocuments(loaded.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), original.FindTopDocuments(query, DocumentStatus::BANNED));
+		}
+		ASSERT_EQUAL(loaded.FindTopDocuments("hedgehog with"s).size(), 1U);
+		ASSERT(loaded.FindTopDocuments("wombat"s).empty());
+		ASSERT(loaded.GetWordFrequencies(5000) == original.GetWordFrequencies(5000));
+		const auto [words, status] = loaded.MatchDocument("curly hat -dog"s, 5000);
+		ASSERT_EQUAL(words.size(), 2U);
+
+		// The loaded server keeps accepting changes on top of the mapped file
+		loaded.RemoveDocument(5000);
+		ASSERT(loaded.FindTopDocuments("hedgehog"s).empty());
+		loaded.AddDocument(5000, "hedgehog and wombat"s, DocumentStatus::ACTUAL, {2});
+		loaded.AddDocument(5002, "cat wombat"s, DocumentStatus::ACTUAL, {2});
+		ASSERT_EQUAL(loaded.FindTopDocuments("wombat hedgehog"s).size(), 2U);
+		ASSERT_EQUAL(loaded.FindTopDocuments("hedgehog"s)[0].id, 5000);
+		loaded.FlushIndex();
+		loaded.WaitForIndexMerges();
+		ASSERT_EQUAL(loaded.FindTopDocuments("wombat"s).size(), 2U);
+		ASSERT_EQUAL(get<0>(loaded.MatchDocument("cat wombat"s, 5002)).size(), 2U);
+
+		// Saving over the file the server maps leaves its mapping intact
+		const vector<Document> expected = loaded.FindTopDocuments("cat wombat hedgehog"s);
+		loaded.Save(path);
+		AssertSameDocuments(loaded.FindTopDocuments("cat wombat hedgehog"s), expected);
+		ASSERT_EQUAL(get<0>(loaded.MatchDocument("cat wombat"s, 5002)).size(), 2U);
+		AssertSameDocuments(SearchServer::Load(path).FindTopDocuments("cat wombat hedgehog"s), expected);
+		ASSERT(!filesystem::exists(path + ".tmp"s));
+	}
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "definitely not an index"s;
+	}
+	try {
+		SearchServer::Load(path);
+		ASSERT_HINT(false, "Loading a corrupted file must throw"s);
+	} catch (const invalid_argument&) {
+	}
+	filesystem::remove(path);
+}
+
+void TestTokenizer() {
+	const auto split_reference = [](string_view text) {
+		vector<string_view> words;
+		size_t first_invalid_word = string_view::npos;
+		while (!text.empty()) {
+			const size_t end = min(text.find(' '), text.size());
+			if (end > 0U) {
+				const string_view word = text.substr(0, end);
+				if (first_invalid_word == string_view::npos && any_of(word.begin(), word.end(), [](char c) { return static_cast<unsigned char>(c) < ' '; })) {
+					first_invalid_word = words.size();
+				}
+				words.push_back(word);
+			}
+			text.remove_prefix(min(end + 1U, text.size()));
+		}
+
+		return pair{words, first_invalid_word == string_view::npos ? words.size() : first_invalid_word};
+	};
+
+	ASSERT(Tokenize(""sv).words.empty());
+	ASSERT(Tokenize("   "sv).words.empty());
+	ASSERT_EQUAL(Tokenize("  curly   cat "sv).words, (vector<string_view>{"curly"sv, "cat"sv}));
+
+	// Random texts of all lengths around the block size, with space runs, controls and non-ASCII bytes
+	mt19937 generator(7);
+	const string alphabet = "ab  \xd0\xba\x01\t"s;
+	uniform_int_distribution<size_t> letter(0U, alphabet.size() - 1U);
+	uniform_int_distribution<int> control_chance(0, 3);
+	for (size_t length = 0; length < 140U; ++length) {
+		string text;
+		for (size_t i = 0; i < length; ++i) {
+			const char c = alphabet[letter(generator)];
+			text += (static_cast<unsigned char>(c) < ' ' && control_chance(generator) != 0) ? 'z' : c;
+		}
+		const TokenizedText tokens = Tokenize(text);
+		const auto [words, first_invalid_word] = split_reference(text);
+		ASSERT_EQUAL_HINT(tokens.words, words, text);
+		ASSERT_EQUAL_HINT(tokens.first_invalid_word, first_invalid_word, text);
+	}
+
+	SearchServer search_server("and"s);
+	search_server.AddDocument(1, "  curly  and   cat  "s, DocumentStatus::ACTUAL, {1});
+	ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 2U);
+	ASSERT_EQUAL(search_server.GetWordFrequencies(1).at("cat"sv), 0.5);
+	ASSERT_EQUAL(search_server.FindTopDocuments("  cat   -dog "s).size(), 1U);
+	try {
+		search_server.AddDocument(2, "curly d\x12g"s, DocumentStatus::ACTUAL, {1});
+		ASSERT_HINT(false, "A word with a control character must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+	try {
+		search_server.FindTopDocuments("cat -d\x12g"s);
+		ASSERT_HINT(false, "A query word with a control character must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+}
+
+void TestTermInterning() {
+	TermDictionary dictionary;
+	vector<string> terms;
+	for (int i = 0; i < 5000; ++i) {
+		terms.push_back("term"s + to_string(i * 7919));
+	}
+	terms.push_back("a rather long term that does not fit into the small string buffer"s);
+	for (size_t i = 0; i < terms.size(); ++i) {
+		ASSERT_EQUAL(dictionary.Insert(terms[i]), i);
+	}
+	for (size_t i = 0; i < terms.size(); ++i) {
+		ASSERT_EQUAL(dictionary.Find(terms[i]), i);
+		ASSERT_EQUAL(dictionary.GetTerm(static_cast<TermId>(i)), terms[i]);
+	}
+	ASSERT_EQUAL(dictionary.Insert(terms[42]), 42U);
+
+	// Erasing shifts probe sequences back; every other term must stay reachable
+	const string_view kept_view = dictionary.GetTerm(1);
+	for (TermId term_id = 0; term_id < 5000U; term_id += 2U) {
+		dictionary.Erase(term_id);
+	}
+	ASSERT_EQUAL(dictionary.GetSize(), 2501U);
+	for (size_t i = 0; i < terms.size(); ++i) {
+		ASSERT_EQUAL(dictionary.Find(terms[i]), (i % 2U == 0U && i < 5000U) ? NO_TERM : i);
+	}
+	ASSERT_EQUAL(dictionary.Insert("term-reused"s), 4998U);
+	ASSERT(!dictionary.IsLive(4996U));
+	ASSERT(dictionary.IsLive(4998U));
+	ASSERT_EQUAL_HINT(kept_view.data(), dictionary.GetTerm(1).data(), "Erasing must not move other terms"s);
+
+	const TermMemoryUsage usage = dictionary.GetMemoryUsage();
+	ASSERT_EQUAL(usage.term_count, dictionary.GetSize());
+	size_t text_size = 0;
+	for (TermId term_id = 0; term_id < dictionary.GetIdBound(); ++term_id) {
+		if (dictionary.IsLive(term_id)) {
+			text_size += dictionary.GetTerm(term_id).size();
+		}
+	}
+	ASSERT_EQUAL(usage.text_size, text_size);
+	ASSERT(usage.used_bytes < usage.node_layout_bytes);
+
+	const TermDictionary copy = dictionary;
+	ASSERT_EQUAL(copy.Find("term-reused"sv), 4998U);
+	ASSERT(copy.GetTerm(1).data() != dictionary.GetTerm(1).data());
+
+	// Replacing the whole vocabulary by new terms of the same lengths, short and long,
+	// reuses the released space
+	TermDictionary churned;
+	const auto make_term = [](int round, int index) {
+		string term = to_string(round) + "-"s + to_string(index) + "-"s;
+		term.resize(12U + static_cast<size_t>(index * 37 % 300), 'x');
+		return term;
+	};
+	size_t first_round_bytes = 0;
+	for (int round = 0; round < 10; ++round) {
+		for (TermId term_id = 0; term_id < churned.GetIdBound(); ++term_id) {
+			churned.Erase(term_id);
+		}
+		for (int index = 0; index < 2000; ++index) {
+			churned.Insert(make_term(round, index));
+		}
+		if (round == 1) {
+			first_round_bytes = churned.GetMemoryUsage().used_bytes;
+		}
+	}
+	ASSERT_EQUAL(churned.GetSize(), 2000U);
+	ASSERT_EQUAL(churned.GetTerm(churned.Find(make_term(9, 1999))), make_term(9, 1999));
+	ASSERT_EQUAL_HINT(churned.GetMemoryUsage().used_bytes, first_round_bytes, "Vocabulary churn must not grow the dictionary"s);
+}
+
+void TestCorpusIngestion() {
+	{
+		TextArena arena(8U);
+		const string_view short_text = arena.Store("cat"sv);
+		const string_view long_text = arena.Store("a string longer than a block"sv);
+		const string_view next_text = arena.Store("dog"sv);
+		ASSERT_EQUAL(short_text, "cat"sv);
+		ASSERT_EQUAL(long_text, "a string longer than a block"sv);
+		ASSERT_EQUAL_HINT(next_text.data(), short_text.data() + short_text.size(), "Oversized text must not waste the current block"s);
+		ASSERT_EQUAL(arena.GetUsedSize(), 34U);
+
+		TextArena moved = move(arena);
+		ASSERT_EQUAL(short_text, "cat"sv);
+		ASSERT_EQUAL(moved.Store(""sv).size(), 0U);
+		const size_t capacity = moved.GetCapacity();
+		moved.Release(long_text);
+		ASSERT_EQUAL_HINT(moved.GetCapacity(), capacity - long_text.size(), "Releasing oversized text must free its block"s);
+		ASSERT_EQUAL(next_text, "dog"sv);
+	}
+
+	// Documents removed and added all day with ever new words, some longer than an arena
+	// block, leave the server holding as much text as after the first round
+	{
+		SearchServer search_server("with and"s);
+		size_t first_round_bytes = 0;
+		for (int round = 0; round < 8; ++round) {
+			for (int id = 0; id < 200; ++id) {
+				string text = "curly cat "s;
+				string word = "r"s + to_string(round) + "d"s + to_string(id) + "w"s;
+				word.resize(id == 0 ? 100000U : 16U + static_cast<size_t>(id * 13 % 180), 'x');
+				text += word;
+				search_server.AddDocument(round * 1000 + id, text, DocumentStatus::ACTUAL, {1});
+			}
+			if (round > 0) {
+				for (int id = 0; id < 200; ++id) {
+					search_server.RemoveDocument((round - 1) * 1000 + id);
+				}
+			}
+			if (round == 1) {
+				first_round_bytes = search_server.GetTermMemoryUsage().used_bytes;
+			}
+		}
+		ASSERT_EQUAL(search_server.GetDocumentCount(), 200);
+		ASSERT_EQUAL_HINT(search_server.GetTermMemoryUsage().used_bytes, first_round_bytes, "Removed documents must give their text back"s);
+	}
+
+	const string path = (filesystem::temp_directory_path() / "search_engine_test.corpus"s).string();
+	const vector<GeneratedDocument> documents = GenerateDocuments(300);
+	const string_view status_names[] = {"ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv};
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		for (const GeneratedDocument& document : documents) {
+			out << document.id << '\t' << status_names[static_cast<int>(document.status)] << '\t'
+				<< document.ratings[0] << ' ' << document.ratings[1] << '\t' << document.text << "\r\n\n"s;
+		}
+	}
+	{
+		SearchServer expected = GenerateSearchServer(300);
+		SearchServer loaded("with and"s);
+		AddDocumentsFromFile(execution::par, loaded, path, 64U);
+		ASSERT_EQUAL(loaded.GetDocumentCount(), expected.GetDocumentCount());
+		for (const string& query : GENERATED_QUERIES) {
+			AssertSameDocuments(loaded.FindTopDocuments(query), expected.FindTopDocuments(query));
+			AssertSameDocuments(loaded.FindTopDocuments(query, DocumentStatus::REMOVED), expected.FindTopDocuments(query, DocumentStatus::REMOVED));
+		}
+	}
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "1\tACTUAL\t1 2\tcurly cat\n2\tACTIVE\t3\tcurly dog\n"s;
+	}
+	try {
+		SearchServer search_server(""s);
+		AddDocumentsFromFile(search_server, path);
+		ASSERT_HINT(false, "A malformed record must throw"s);
+	} catch (const invalid_argument&) {
+	}
+	filesystem::remove(path);
+}
+
+void TestRelevanceAccumulator() {
+	RelevanceAccumulator accumulator;
+	accumulator.Reset(100, 200, 50U);
+	ASSERT(accumulator.IsDense());
+	accumulator.Reset(100, 100000, 50U);
+	ASSERT(!accumulator.IsDense());
+
+	// The same additions give the same sums in both layouts, over several reuses
+	mt19937 generator(7);
+	uniform_int_distribution<int> document_ids(1000, 1999);
+	for (int round = 0; round < 6; ++round) {
+		const bool dense = round % 2 == 0;
+		accumulator.Reset(1000, 2000, dense ? 1000U : 1U);
+		ASSERT_EQUAL(accumulator.IsDense(), dense);
+		map<int, double> expected;
+		for (int i = 0; i < 300; ++i) {
+			const int document_id = document_ids(generator);
+			accumulator.Add(document_id, i * 0.5);
+			expected[document_id] += i * 0.5;
+		}
+		// Exclusions hold for documents not added yet and for later additions
+		set<int> excluded;
+		for (int i = 0; i < 50; ++i) {
+			const int document_id = document_ids(generator);
+			accumulator.Exclude(document_id);
+			expected.erase(document_id);
+			excluded.insert(document_id);
+		}
+		for (int i = 0; i < 100; ++i) {
+			const int document_id = document_ids(generator);
+			accumulator.Add(document_id, 1.0);
+			if (excluded.count(document_id) == 0U) {
+				expected[document_id] += 1.0;
+			}
+		}
+		map<int, double> actual;
+		accumulator.ForEach([&actual](int document_id, double relevance) {
+			ASSERT(actual.emplace(document_id, relevance).second);
+		});
+		ASSERT(actual == expected);
+	}
+}
+
+void TestProcessQueryBatch() {
+	// More documents than one shared scan window, some of them removed. Documents with a
+	// rare word come first, so that later windows skip the rows of common words.
+	SearchServer search_server("with and"s);
+	for (int i = 0; i < 300; ++i) {
+		search_server.AddDocument(1000000 + i, i % 2 == 0 ? "zebra"s : "zebra pet"s, DocumentStatus::ACTUAL, {i % 7});
+	}
+	for (const GeneratedDocument& document : GenerateDocuments(20000)) {
+		search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+	}
+	for (int i = 0; i < 40; ++i) {
+		search_server.AddDocument(2000000 + i, i % 2 == 0 ? "zebra cat"s : "curly zebra cat cat"s, DocumentStatus::ACTUAL, {i % 5});
+	}
+	for (int document_id = 0; document_id < 20000 * 7; document_id += 7 * 5) {
+		search_server.RemoveDocument(document_id);
+	}
+
+	vector<string> queries = GENERATED_QUERIES;
+	queries.insert(queries.end(), {"cat zebra"s, "zebra funny rat -dog"s, "curly zebra pet"s});
+	mt19937 generator(3);
+	uniform_int_distribution<int> word_count(1, 4);
+	for (int i = 0; i < 200; ++i) {
+		string query = GenerateText(generator, word_count(generator));
+		if (i % 3 == 0) {
+			query += " -"s + GenerateText(generator, 1);
+		}
+		queries.push_back(query);
+	}
+	// Repeated queries are evaluated once but answered for every copy
+	queries.insert(queries.end(), queries.begin(), queries.begin() + 50);
+
+	// Larger result limits send longer rows to the shared scan
+	for (const size_t max_result_document_count : {5U, 30U, 200U}) {
+		search_server.SetMaxResultDocumentCount(max_result_document_count);
+		const QueryBatchResults batch = ProcessQueryBatch(search_server, queries);
+		ASSERT_EQUAL(batch.GetQueryCount(), queries.size());
+		const vector<vector<Document>> results = ProcessQueries(search_server, queries);
+		vector<Document> joined;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			const vector<Document> expected = search_server.FindTopDocuments(queries[i]);
+			const auto documents = batch.GetResults(i);
+			AssertSameDocuments(vector<Document>(documents.begin(), documents.end()), expected);
+			AssertSameDocuments(results[i], expected);
+			joined.insert(joined.end(), expected.begin(), expected.end());
+		}
+		AssertSameDocuments(ProcessQueriesJoined(search_server, queries), joined);
+	}
+}
+
+void TestResultCache() {
+	SearchServer expected = GenerateSearchServer(200);
+	SearchServer search_server = GenerateSearchServer(200);
+	search_server.SetResultCacheCapacity(4U);
+
+	for (int round = 0; round < 2; ++round) {
+		AssertSameDocuments(search_server.FindTopDocuments("curly cat -dog"s), expected.FindTopDocuments("curly cat -dog"s));
+	}
+	// Word order, repeats, stop words and unknown words do not change the key
+	AssertSameDocuments(search_server.FindTopDocuments("-dog cat with curly cat zzz"s), expected.FindTopDocuments("curly cat -dog"s));
+	ASSERT_EQUAL(search_server.GetResultCacheStats().hits, 2U);
+	ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 1U);
+	// The status is part of the key
+	AssertSameDocuments(search_server.FindTopDocuments("curly cat -dog"s, DocumentStatus::BANNED), expected.FindTopDocuments("curly cat -dog"s, DocumentStatus::BANNED));
+	ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 2U);
+
+	// Changes of the documents outdate the cached results
+	for (SearchServer* server : {&search_server, &expected}) {
+		server->AddDocument(100000, "curly curly cat"s, DocumentStatus::ACTUAL, {10});
+	}
+	AssertSameDocuments(search_server.FindTopDocuments("curly cat -dog"s), expected.FindTopDocuments("curly cat -dog"s));
+	ASSERT_EQUAL(search_server.FindTopDocuments("curly cat -dog"s)[0].id, 100000);
+	for (SearchServer* server : {&search_server, &expected}) {
+		server->RemoveDocument(100000);
+	}
+	AssertSameDocuments(search_server.FindTopDocuments("curly cat -dog"s), expected.FindTopDocuments("curly cat -dog"s));
+	for (SearchServer* server : {&search_server, &expected}) {
+		server->SetMaxResultDocumentCount(2U);
+	}
+	AssertSameDocuments(search_server.FindTopDocuments("curly cat -dog"s), expected.FindTopDocuments("curly cat -dog"s));
+
+	for (const string& query : GENERATED_QUERIES) {
+		AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query));
+	}
+	ASSERT(search_server.GetResultCacheStats().size <= 4U);
+
+	// Concurrent readers share the cache
+	const ResultCacheStats before = search_server.GetResultCacheStats();
+	vector<thread> threads;
+	atomic<bool> is_consistent = true;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&search_server, &expected, &is_consistent]() {
+			vector<Document> result;
+			for (int round = 0; round < 50; ++round) {
+				for (const string& query : GENERATED_QUERIES) {
+					search_server.FindTopDocuments(query, result);
+					is_consistent = is_consistent && result.size() == expected.FindTopDocuments(query).size();
+				}
+			}
+		});
+	}
+	for (thread& thread : threads) {
+		thread.join();
+	}
+	ASSERT(is_consistent);
+	const ResultCacheStats after = search_server.GetResultCacheStats();
+	ASSERT_EQUAL(after.hits + after.misses - before.hits - before.misses, 4U * 50U * GENERATED_QUERIES.size());
+
+	SearchServer copy = search_server;
+	ASSERT_EQUAL(copy.GetResultCacheStats().size, 0U);
+	search_server.SetResultCacheCapacity(0U);
+	ASSERT_EQUAL(search_server.GetResultCacheStats().hits, 0U);
+}
+
+void TestRequestQueue() {
+	using namespace std::chrono;
+
+	const SearchServer search_server = GenerateSearchServer(200);
+	{
+		RequestWindowOptions options;
+		options.window = 10s;
+		options.bucket_count = 10U;
+		RequestQueue request_queue(search_server, options);
+		const RequestQueue::Clock::time_point start(1000h);
+
+		request_queue.RecordRequest(3U, 0us, start);
+		request_queue.RecordRequest(0U, 1us, start + 500ms);
+		request_queue.RecordRequest(0U, 3us, start + 5s);
+		request_queue.RecordRequest(1U, 1h, start + 9s);
+		RequestStats stats = request_queue.GetStats(10s, start + 9s);
+		ASSERT_EQUAL(stats.request_count, 4U);
+		ASSERT_EQUAL(stats.no_result_count, 2U);
+		ASSERT_EQUAL(stats.latency_counts[0], 1U);
+		ASSERT_EQUAL(stats.latency_counts[1], 1U);
+		ASSERT_EQUAL(stats.latency_counts[2], 1U);
+		ASSERT_EQUAL(stats.latency_counts[LATENCY_BUCKET_COUNT - 1U], 1U);
+
+		// Shorter windows and windows sliding past requests
+		ASSERT_EQUAL(request_queue.GetStats(5s, start + 9s).request_count, 2U);
+		ASSERT_EQUAL(request_queue.GetStats(1h, start + 12s).request_count, 2U);
+		ASSERT_EQUAL(request_queue.GetStats(1h, start + 12s).no_result_count, 1U);
+		// A request reusing the ring bucket of an old one replaces it
+		request_queue.RecordRequest(0U, 0us, start + 10s + 100ms);
+		stats = request_queue.GetStats(10s, start + 10s + 100ms);
+		ASSERT_EQUAL(stats.request_count, 3U);
+		ASSERT_EQUAL(stats.no_result_count, 2U);
+		ASSERT_EQUAL(request_queue.GetStats(10s, start + 30s).request_count, 0U);
+	}
+
+	// Worker threads share one queue
+	RequestWindowOptions options;
+	RequestQueue request_queue(search_server, options);
+	vector<thread> threads;
+	atomic<bool> is_consistent = true;
+	for (int i = 0; i < 8; ++i) {
+		threads.emplace_back([&search_server, &request_queue, &is_consistent, i]() {
+			for (int round = 0; round < 100; ++round) {
+				const string& query = GENERATED_QUERIES[(i + round) % GENERATED_QUERIES.size()];
+				is_consistent = is_consistent && request_queue.AddFindRequest(query).size() == search_server.FindTopDocuments(query).size();
+				request_queue.AddFindRequest("nonexistent"s);
+			}
+		});
+	}
+	for (thread& thread : threads) {
+		thread.join();
+	}
+	ASSERT(is_consistent);
+	const RequestStats stats = request_queue.GetStats();
+	ASSERT_EQUAL(stats.request_count, 8U * 100U * 2U);
+	ASSERT(stats.no_result_count >= 8U * 100U);
+	ASSERT_EQUAL(request_queue.GetNoResultRequests(), static_cast<int>(stats.no_result_count));
+	ASSERT_EQUAL(accumulate(stats.latency_counts.begin(), stats.latency_counts.end(), uint64_t(0)), stats.request_count);
+
+	// A thread counts into separate rings of separate queues
+	RequestQueue other_queue(search_server);
+	other_queue.AddFindRequest("cat"s);
+	request_queue.AddFindRequest("cat"s);
+	ASSERT_EQUAL(other_queue.GetStats().request_count, 1U);
+	ASSERT_EQUAL(request_queue.GetStats().request_count, stats.request_count + 1U);
+
+	// A thread serving many short-lived queues forgets the rings of destroyed ones
+	for (int i = 0; i < 1000; ++i) {
+		RequestQueue short_lived(search_server);
+		short_lived.RecordRequest(0U, 1us, RequestQueue::Clock::now());
+		ASSERT_EQUAL(short_lived.GetStats().request_count, 1U);
+		// The rings of request_queue, other_queue and short_lived
+		ASSERT_EQUAL(RequestQueue::GetThreadRingCount(), 3U);
+	}
+}
+
+void TestSearchExecutor() {
+	SearchServer search_server = GenerateSearchServer(5000);
+	search_server.SetMaxResultDocumentCount(20U);
+	const vector<string> queries = {
+		"cat"s, "curly cat -dog"s, "nasty big rat -john -hair"s, "white black fish bird tail eyes hat"s,
+		"pet funny -cat -dog"s, "unknown words only"s, "-cat"s, "dog rat bird"s,
+	};
+
+	for (const size_t split_posting_count : {size_t{1}, SIZE_MAX}) {
+		SearchExecutorOptions options;
+		options.thread_count = 4U;
+		options.split_posting_count = split_posting_count;
+		SearchExecutor executor(search_server, options);
+		vector<future<vector<Document>>> results;
+		for (int round = 0; round < 20; ++round) {
+			for (const string& query : queries) {
+				results.push_back(executor.Submit(query, round % 2 == 0 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED));
+			}
+		}
+		for (size_t i = 0; i < results.size(); ++i) {
+			const DocumentStatus status = (i / queries.size()) % 2U == 0U ? DocumentStatus::ACTUAL : DocumentStatus::BANNED;
+			AssertSameDocuments(results[i].get(), search_server.FindTopDocuments(queries[i % queries.size()], status));
+		}
+		ASSERT_EQUAL(executor.GetStats().accepted, results.size());
+		ASSERT_EQUAL(executor.GetStats().split > 0U, split_posting_count == 1U);
+
+		// Errors of a search reach the future
+		future<vector<Document>> invalid = executor.Submit("cat --dog"s);
+		try {
+			invalid.get();
+			ASSERT_HINT(false, "Invalid query must fail"s);
+		} catch (const invalid_argument&) {
+		}
+	}
+
+	// Queries beyond the pending limit are shed
+	SearchExecutorOptions options;
+	options.thread_count = 2U;
+	options.max_pending_queries = 1U;
+	SearchExecutor executor(search_server, options);
+	promise<void> release;
+	shared_future<void> released = release.get_future().share();
+	ASSERT(executor.Submit("cat"s, DocumentStatus::ACTUAL, [released](vector<Document>, exception_ptr) {
+		released.wait();
+	}));
+	ASSERT(!executor.Submit("cat"s, DocumentStatus::ACTUAL, [](vector<Document>, exception_ptr) {}));
+	future<vector<Document>> rejected = executor.Submit("cat"s);
+	try {
+		rejected.get();
+		ASSERT_HINT(false, "Saturated executor must reject queries"s);
+	} catch (const QueryRejectedError&) {
+	}
+	ASSERT_EQUAL(executor.GetStats().rejected, 2U);
+	release.set_value();
+	while (executor.GetPendingQueryCount() > 0U) {
+		this_thread::yield();
+	}
+	ASSERT_EQUAL(executor.Submit("cat"s).get().size(), search_server.FindTopDocuments("cat"s).size());
+
+	// Destruction answers the accepted queries
+	atomic<int> answered = 0;
+	{
+		SearchExecutorOptions drain_options;
+		drain_options.thread_count = 3U;
+		SearchExecutor drained(search_server, drain_options);
+		for (int i = 0; i < 100; ++i) {
+			ASSERT(drained.Submit(queries[i % queries.size()], DocumentStatus::ACTUAL, [&answered](vector<Document>, exception_ptr) {
+				++answered;
+			}));
+		}
+	}
+	ASSERT_EQUAL(answered.load(), 100);
+}
+
+void TestShardedSearchServer() {
+	const vector<GeneratedDocument> documents = GenerateDocuments(3000);
+	SearchServer expected("with and"s);
+	ShardedSearchServer sharded("with and"s, 4U);
+	ShardedSearchServer single_shard("with and"s, 1U);
+	for (const GeneratedDocument& document : documents) {
+		expected.AddDocument(document.id, document.text, document.status, document.ratings);
+		sharded.AddDocument(document.id, document.text, document.status, document.ratings);
+		single_shard.AddDocument(document.id, document.text, document.status, document.ratings);
+	}
+	ASSERT_EQUAL(sharded.GetShardCount(), 4U);
+	try {
+		sharded.AddDocument(documents[0].id, "cat"s, DocumentStatus::ACTUAL, {1});
+		ASSERT_HINT(false, "Repeated id must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+	for (size_t i = 0; i < documents.size(); i += 7U) {
+		expected.RemoveDocument(documents[i].id);
+		sharded.RemoveDocument(documents[i].id);
+		single_shard.RemoveDocument(documents[i].id);
+	}
+	ASSERT_EQUAL(sharded.GetDocumentCount(), expected.GetDocumentCount());
+
+	for (const size_t result_count : {size_t{5}, size_t{50}}) {
+		expected.SetMaxResultDocumentCount(result_count);
+		sharded.SetMaxResultDocumentCount(result_count);
+		single_shard.SetMaxResultDocumentCount(result_count);
+		for (const string& query : GENERATED_QUERIES) {
+			for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+				AssertSameDocuments(sharded.FindTopDocuments(query, status), expected.FindTopDocuments(query, status));
+				AssertSameDocuments(single_shard.FindTopDocuments(query, status), expected.FindTopDocuments(query, status));
+			}
+			const auto is_even = [](int document_id, DocumentStatus status, int rating) {
+				return document_id % 2 == 0;
+			};
+			AssertSameDocuments(sharded.FindTopDocuments(query, is_even), expected.FindTopDocuments(query, is_even));
+		}
+	}
+
+	for (size_t i = 1; i < documents.size(); i += 97U) {
+		if (i % 7U == 0U) {
+			continue;
+		}
+		const auto [words, status] = sharded.MatchDocument("curly cat -dog"s, documents[i].id);
+		const auto [expected_words, expected_status] = expected.MatchDocument("curly cat -dog"s, documents[i].id);
+		ASSERT(words == expected_words);
+		ASSERT(status == expected_status);
+	}
+}
+
 void TestGetWordFrequencies() {
 	SearchServer search_server(""s);
 	search_server.AddDocument(42, "белый кот и модный ошейник"s, DocumentStatus::BANNED, {1, 2, 3});
@@ -212,9 +1542,33 @@ void TestSearchServer() {
 	RUN_TEST(TestIncludeFindedDocumentsWithStatus);
 	RUN_TEST(TestIncludeFindedDocumentsWithPredicate);
 	RUN_TEST(TestSortByRelevance);
+	RUN_TEST(TestMaxResultDocumentCount);
+	RUN_TEST(TestParallelSearchMatchesSequential);
 	RUN_TEST(TestMatchDocuments);
+	RUN_TEST(TestPreparedQuery);
+	RUN_TEST(TestAddDocuments);
+	RUN_TEST(TestSegmentedIndex);
+	RUN_TEST(TestSnapshotIsolation);
 	RUN_TEST(TestRemoveDuplicates);
 	RUN_TEST(TestRemoveDocument);
+	RUN_TEST(TestRemovedDocumentNotFound);
+	RUN_TEST(TestRemoveDocumentReclaimsTerms);
+	RUN_TEST(TestCompactInternalIds);
+	RUN_TEST(TestIndexFile);
+	RUN_TEST(TestTokenizer);
+	RUN_TEST(TestTermInterning);
+	RUN_TEST(TestCorpusIngestion);
+	RUN_TEST(TestCompressedPostings);
+	RUN_TEST(TestBlockMaxWand);
+	RUN_TEST(TestChampionLists);
+	RUN_TEST(TestDocumentAttributes);
+	RUN_TEST(TestInternalDocumentIds);
+	RUN_TEST(TestRelevanceAccumulator);
+	RUN_TEST(TestProcessQueryBatch);
+	RUN_TEST(TestResultCache);
+	RUN_TEST(TestRequestQueue);
+	RUN_TEST(TestSearchExecutor);
+	RUN_TEST(TestShardedSearchServer);
 	RUN_TEST(TestGetWordFrequencies);
 	RUN_TEST(TestGetDocumentCount);
 
@@ -0,0 +1,124 @@
+#include "../inc/text_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+TextArena::TextArena(size_t block_size)
+	: block_size_(max(block_size, size_t{1})) {
+}
+
+string_view TextArena::Store(string_view text) {
+	if (text.empty()) {
+		return {};
+	}
+	const size_t space_size = GetSpaceSize(text.size());
+	if (space_size > block_size_) {
+		// An oversized string gets a block of its own, freed on release; the current block
+		// keeps receiving text
+		Block block;
+		block.capacity = text.size();
+		block.size = text.size();
+		block.data = make_unique<char[]>(block.capacity);
+		memcpy(block.data.get(), text.data(), text.size());
+		capacity_ += block.capacity;
+		used_size_ += text.size();
+		own_blocks_.push_back(move(block));
+
+		return {own_blocks_.back().data.get(), text.size()};
+	}
+
+	const size_t size_class = GetSizeClass(text.size());
+	if (size_class < free_texts_.size() && !free_texts_[size_class].empty()) {
+		char* const data = free_texts_[size_class].back();
+		free_texts_[size_class].pop_back();
+		memcpy(data, text.data(), text.size());
+		used_size_ += text.size();
+
+		return {data, text.size()};
+	}
+
+	if (blocks_.empty() || blocks_.back().capacity - blocks_.back().size < space_size) {
+		Block block;
+		block.capacity = block_size_;
+		block.data = make_unique<char[]>(block.capacity);
+		capacity_ += block.capacity;
+		blocks_.push_back(move(block));
+	}
+
+	Block& block = blocks_.back();
+	char* const data = block.data.get() + block.size;
+	memcpy(data, text.data(), text.size());
+	block.size += space_size;
+	used_size_ += text.size();
+
+	return {data, text.size()};
+}
+
+void TextArena::Release(string_view text) {
+	if (text.empty()) {
+		return;
+	}
+	used_size_ -= text.size();
+	if (GetSpaceSize(text.size()) > block_size_) {
+		const auto own_block = find_if(own_blocks_.begin(), own_blocks_.end(), [&text](const Block& block) {
+			return block.data.get() == text.data();
+		});
+		capacity_ -= own_block->capacity;
+		*own_block = move(own_blocks_.back());
+		own_blocks_.pop_back();
+		return;
+	}
+	const size_t size_class = GetSizeClass(text.size());
+	if (size_class >= free_texts_.size()) {
+		free_texts_.resize(size_class + 1U);
+	}
+	// The arena hands out views to const text, but owns the bytes
+	free_texts_[size_class].push_back(const_cast<char*>(text.data()));
+}
+
+void TextArena::Clear() {
+	blocks_.clear();
+	own_blocks_.clear();
+	free_texts_.clear();
+	used_size_ = 0;
+	capacity_ = 0;
+}
+
+size_t TextArena::GetUsedSize() const {
+	return used_size_;
+}
+
+size_t TextArena::GetCapacity() const {
+	return capacity_;
+}
+
+size_t TextArena::GetSpaceSize(size_t size) {
+	if (size <= MAX_EXACT_SIZE) {
+		return size;
+	}
+	// Four classes between consecutive powers of two waste at most a fifth of the space
+	size_t power = MAX_EXACT_SIZE;
+	while (power * 2U < size) {
+		power *= 2U;
+	}
+	const size_t step = power / 4U;
+
+	return (size + step - 1U) / step * step;
+}
+
+size_t TextArena::GetSizeClass(size_t size) {
+	if (size <= MAX_EXACT_SIZE) {
+		return size;
+	}
+	size_t size_class = MAX_EXACT_SIZE;
+	size_t power = MAX_EXACT_SIZE;
+	while (power * 2U < size) {
+		power *= 2U;
+		size_class += 4U;
+	}
+
+	return size_class + (GetSpaceSize(size) - power) / (power / 4U);
+}
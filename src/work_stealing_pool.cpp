@@ -0,0 +1,98 @@
+#include "../inc/work_stealing_pool.h"
+
+using namespace std;
+
+namespace {
+	// Pool and deque of the worker running on this thread
+	thread_local const WorkStealingPool* current_pool = nullptr;
+	thread_local size_t current_worker_index = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t thread_count)
+	: queues_(make_unique<TaskQueue[]>(max<size_t>(thread_count, 1U) + 1U))
+	, thread_count_(max<size_t>(thread_count, 1U)) {
+	threads_.reserve(thread_count_);
+	for (size_t i = 0; i < thread_count_; ++i) {
+		threads_.emplace_back([this, i]() {
+			RunWorker(i);
+		});
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		lock_guard guard(sleep_mutex_);
+		is_stopping_ = true;
+	}
+	wake_up_.notify_all();
+	for (thread& worker : threads_) {
+		worker.join();
+	}
+}
+
+void WorkStealingPool::Submit(Task task) {
+	const size_t queue_index = current_pool == this ? current_worker_index : thread_count_;
+	{
+		lock_guard guard(queues_[queue_index].mutex);
+		queues_[queue_index].tasks.push_back(move(task));
+	}
+	queued_count_.fetch_add(1U);
+	// Taking the lock orders the count update before the check of a worker going to sleep
+	{
+		lock_guard guard(sleep_mutex_);
+	}
+	wake_up_.notify_one();
+}
+
+size_t WorkStealingPool::GetThreadCount() const {
+	return thread_count_;
+}
+
+void WorkStealingPool::RunWorker(size_t worker_index) {
+	current_pool = this;
+	current_worker_index = worker_index;
+	Task task;
+	while (true) {
+		if (TryPop(worker_index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		unique_lock lock(sleep_mutex_);
+		wake_up_.wait(lock, [this]() {
+			return is_stopping_ || queued_count_.load() > 0U;
+		});
+		if (is_stopping_ && queued_count_.load() == 0U) {
+			return;
+		}
+	}
+}
+
+bool WorkStealingPool::TryPop(size_t worker_index, Task& task) {
+	if (queued_count_.load() == 0U) {
+		return false;
+	}
+	{
+		TaskQueue& own = queues_[worker_index];
+		lock_guard guard(own.mutex);
+		if (!own.tasks.empty()) {
+			task = move(own.tasks.back());
+			own.tasks.pop_back();
+			queued_count_.fetch_sub(1U);
+			return true;
+		}
+	}
+	// The shared queue first, then the other workers starting from the next one
+	for (size_t i = 0; i < thread_count_; ++i) {
+		TaskQueue& victim = queues_[i == 0U ? thread_count_ : (worker_index + i) % thread_count_];
+		lock_guard guard(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queued_count_.fetch_sub(1U);
+			return true;
+		}
+	}
+
+	return false;
+}